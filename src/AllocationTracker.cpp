@@ -0,0 +1,222 @@
+/************************************************************************
+     File:        AllocationTracker.cpp
+
+     Comment:     Counts every allocation made with new
+
+						The replacements of the global operator new and
+						delete. Each one adds to a counter of the thread's
+						own (no contention) and to the shared ones (a
+						relaxed atomic add), then calls malloc or free.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cstddef>
+#include <atomic>
+#include <new>
+
+#include "AllocationTracker.H"
+
+struct Counters {
+	unsigned long			allocations;
+	unsigned long			frees;
+	unsigned long long	bytes;
+};
+
+// plain data, so nothing has to be constructed before the first new
+static thread_local Counters thread_counts = { 0, 0, 0 };
+static std::atomic<unsigned long> total_allocations(0);
+static std::atomic<unsigned long> total_frees(0);
+static std::atomic<unsigned long long> total_bytes(0);
+
+static void counted(size_t bytes)
+{
+	++thread_counts.allocations;
+	thread_counts.bytes += bytes;
+	total_allocations.fetch_add(1, std::memory_order_relaxed);
+	total_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+static void countFree()
+{
+	++thread_counts.frees;
+	total_frees.fetch_add(1, std::memory_order_relaxed);
+}
+
+//****************************************************************************
+//
+// * malloc, and what new has to do when there is none (call the new
+//   handler until it gives up)
+//============================================================================
+static void* allocate(size_t bytes, size_t alignment, bool nothrow)
+//============================================================================
+{
+	if (!bytes)
+		bytes = 1;
+	counted(bytes);
+	while (true) {
+		void* memory;
+		if (alignment <= alignof(std::max_align_t))
+			memory = malloc(bytes);
+#ifdef _WIN32
+		else
+			memory = _aligned_malloc(bytes, alignment);
+#else
+		else if (posix_memalign(&memory, alignment, bytes))
+			memory = nullptr;
+#endif
+		if (memory)
+			return memory;
+
+		std::new_handler handler = std::get_new_handler();
+		if (!handler) {
+			if (nothrow)
+				return nullptr;
+			throw std::bad_alloc();
+		}
+		handler();
+	}
+}
+
+static void release(void* memory, size_t alignment)
+{
+	if (!memory)
+		return;
+	countFree();
+#ifdef _WIN32
+	if (alignment > alignof(std::max_align_t)) {
+		_aligned_free(memory);
+		return;
+	}
+#endif
+	(void) alignment;
+	free(memory);
+}
+
+void* operator new(size_t bytes)
+{
+	return allocate(bytes, 0, false);
+}
+void* operator new[](size_t bytes)
+{
+	return allocate(bytes, 0, false);
+}
+void* operator new(size_t bytes, const std::nothrow_t&) noexcept
+{
+	return allocate(bytes, 0, true);
+}
+void* operator new[](size_t bytes, const std::nothrow_t&) noexcept
+{
+	return allocate(bytes, 0, true);
+}
+void* operator new(size_t bytes, std::align_val_t alignment)
+{
+	return allocate(bytes, (size_t) alignment, false);
+}
+void* operator new[](size_t bytes, std::align_val_t alignment)
+{
+	return allocate(bytes, (size_t) alignment, false);
+}
+void* operator new(size_t bytes, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return allocate(bytes, (size_t) alignment, true);
+}
+void* operator new[](size_t bytes, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return allocate(bytes, (size_t) alignment, true);
+}
+
+void operator delete(void* memory) noexcept
+{
+	release(memory, 0);
+}
+void operator delete[](void* memory) noexcept
+{
+	release(memory, 0);
+}
+void operator delete(void* memory, size_t) noexcept
+{
+	release(memory, 0);
+}
+void operator delete[](void* memory, size_t) noexcept
+{
+	release(memory, 0);
+}
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+	release(memory, 0);
+}
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+	release(memory, 0);
+}
+void operator delete(void* memory, std::align_val_t alignment) noexcept
+{
+	release(memory, (size_t) alignment);
+}
+void operator delete[](void* memory, std::align_val_t alignment) noexcept
+{
+	release(memory, (size_t) alignment);
+}
+void operator delete(void* memory, size_t, std::align_val_t alignment) noexcept
+{
+	release(memory, (size_t) alignment);
+}
+void operator delete[](void* memory, size_t, std::align_val_t alignment) noexcept
+{
+	release(memory, (size_t) alignment);
+}
+void operator delete(void* memory, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	release(memory, (size_t) alignment);
+}
+void operator delete[](void* memory, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	release(memory, (size_t) alignment);
+}
+
+//============================================================================
+AllocationTracker::Counts AllocationTracker::Counts::
+operator-(const Counts& other) const
+//============================================================================
+{
+	Counts difference;
+	difference.allocations = allocations - other.allocations;
+	difference.frees = frees - other.frees;
+	difference.bytes = bytes - other.bytes;
+	return difference;
+}
+
+//============================================================================
+AllocationTracker::Counts AllocationTracker::
+thread()
+//============================================================================
+{
+	Counts counts;
+	counts.allocations = thread_counts.allocations;
+	counts.frees = thread_counts.frees;
+	counts.bytes = thread_counts.bytes;
+	return counts;
+}
+
+//============================================================================
+AllocationTracker::Counts AllocationTracker::
+total()
+//============================================================================
+{
+	Counts counts;
+	counts.allocations = total_allocations.load(std::memory_order_relaxed);
+	counts.frees = total_frees.load(std::memory_order_relaxed);
+	counts.bytes = total_bytes.load(std::memory_order_relaxed);
+	return counts;
+}
+
+void AllocationTracker::
+print(const char* what, const Counts& counts)
+{
+	printf("%s: %lu allocations (%llu bytes), %lu frees\n",
+		what, counts.allocations, counts.bytes, counts.frees);
+}
@@ -0,0 +1,393 @@
+/************************************************************************
+     File:        AudioEngine.cpp
+
+     Comment:     Positional sound for the water (the splashes)
+
+						Only the audio thread touches OpenAL once it is
+						started - load before, commands after.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+
+#include <AL/alext.h>
+
+#include "AudioEngine.H"
+
+// how often the thread looks at the queue and the voices
+static const std::chrono::milliseconds tick(5);
+// the loopback device's format
+static const int loopbackRate = 44100;
+
+// the splashes are heard across the pool (it is 200 across), fading
+// with distance beyond a quarter of it
+static const float referenceDistance = 50.0f;
+static const float maxDistance = 1000.0f;
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+AudioEngine::
+AudioEngine()
+	: voices_started(0), device(nullptr), context(nullptr), loopback(false),
+	  stopping(false), stolen_count(0), dropped_count(0)
+//============================================================================
+{
+	for (int i = 0; i < voiceCount; i++) {
+		voices[i].source = 0;
+		voices[i].busy = false;
+		voices[i].priority = PriorityLow;
+		voices[i].started = 0;
+	}
+}
+
+AudioEngine::
+~AudioEngine()
+{
+	stop();
+}
+
+//****************************************************************************
+//
+// * Read a .wav into a sound (it goes to OpenAL in start)
+//============================================================================
+AudioEngine::SoundId AudioEngine::
+load(const char* path)
+//============================================================================
+{
+	if (running()) {
+		printf("AudioEngine: %s - sounds are loaded before start\n", path);
+		return -1;
+	}
+	Sound sound;
+	if (!readWav(path, sound)) {
+		printf("AudioEngine: can't read %s\n", path);
+		return -1;
+	}
+	sound.buffer = 0;
+	sounds.push_back(sound);
+	return (SoundId) sounds.size() - 1;
+}
+
+//****************************************************************************
+//
+// * The RIFF chunks of a PCM .wav: "fmt " says what the samples are,
+//   "data" holds them. anything else (lists, cues) is skipped
+//============================================================================
+bool AudioEngine::
+readWav(const char* path, Sound& sound)
+//============================================================================
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+	std::vector<unsigned char> bytes;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (size > 12) {
+		bytes.resize(size);
+		if (fread(&bytes[0], 1, size, file) != (size_t) size)
+			bytes.clear();
+	}
+	fclose(file);
+	if (bytes.size() < 12 || memcmp(&bytes[0], "RIFF", 4) || memcmp(&bytes[8], "WAVE", 4))
+		return false;
+
+	// little endian fields
+	auto u16 = [&bytes](size_t at) { return (unsigned) bytes[at] | ((unsigned) bytes[at + 1] << 8); };
+	auto u32 = [&bytes, &u16](size_t at) { return u16(at) | (u16(at + 2) << 16); };
+
+	int channels = 0, bits = 0;
+	bool found_data = false;
+	sound.frequency = 0;
+	for (size_t at = 12; at + 8 <= bytes.size(); ) {
+		size_t length = u32(at + 4);
+		size_t body = at + 8;
+		if (body + length > bytes.size())
+			length = bytes.size() - body;
+
+		if (!memcmp(&bytes[at], "fmt ", 4) && length >= 16) {
+			// 1: integer PCM - nothing compressed
+			if (u16(body) != 1)
+				return false;
+			channels = u16(body + 2);
+			sound.frequency = (ALsizei) u32(body + 4);
+			bits = u16(body + 14);
+		}
+		else if (!memcmp(&bytes[at], "data", 4)) {
+			sound.data.assign(bytes.begin() + body, bytes.begin() + body + length);
+			found_data = true;
+		}
+		// chunks are padded to an even size
+		at = body + length + (length & 1);
+	}
+	if (!found_data || !sound.frequency)
+		return false;
+
+	if (channels == 1 && bits == 8)			sound.format = AL_FORMAT_MONO8;
+	else if (channels == 1 && bits == 16)	sound.format = AL_FORMAT_MONO16;
+	else if (channels == 2 && bits == 8)	sound.format = AL_FORMAT_STEREO8;
+	else if (channels == 2 && bits == 16)	sound.format = AL_FORMAT_STEREO16;
+	else
+		return false;
+	if (channels == 2)
+		printf("AudioEngine: %s is stereo - it won't be positional\n", path);
+	return true;
+}
+
+//****************************************************************************
+//
+// * Open the device, make the voices and buffers, start the thread
+//============================================================================
+bool AudioEngine::
+start(bool loopback)
+//============================================================================
+{
+	if (running())
+		return true;
+
+	this->loopback = loopback;
+	if (loopback) {
+		if (!openLoopback())
+			return false;
+	}
+	else {
+		device = alcOpenDevice(nullptr);
+		if (!device) {
+			printf("AudioEngine: no audio device - no sound\n");
+			return false;
+		}
+		context = alcCreateContext(device, nullptr);
+	}
+	if (!context || !alcMakeContextCurrent(context)) {
+		printf("AudioEngine: can't make an OpenAL context - no sound\n");
+		if (context)
+			alcDestroyContext(context);
+		alcCloseDevice(device);
+		context = nullptr;
+		device = nullptr;
+		return false;
+	}
+
+	for (size_t i = 0; i < sounds.size(); i++) {
+		Sound& sound = sounds[i];
+		alGenBuffers(1, &sound.buffer);
+		alBufferData(sound.buffer, sound.format, &sound.data[0], (ALsizei) sound.data.size(), sound.frequency);
+		// OpenAL has its own copy now
+		std::vector<char>().swap(sound.data);
+	}
+	for (int i = 0; i < voiceCount; i++) {
+		Voice& voice = voices[i];
+		alGenSources(1, &voice.source);
+		alSourcef(voice.source, AL_REFERENCE_DISTANCE, referenceDistance);
+		alSourcef(voice.source, AL_MAX_DISTANCE, maxDistance);
+		voice.busy = false;
+	}
+	alDistanceModel(AL_INVERSE_DISTANCE_CLAMPED);
+
+	// the thread has OpenAL from here on
+	alcMakeContextCurrent(nullptr);
+	stopping = false;
+	thread = std::thread(&AudioEngine::run, this);
+	return true;
+}
+
+//****************************************************************************
+//
+// * OpenAL Soft's loopback device - mixed on demand, played nowhere
+//============================================================================
+bool AudioEngine::
+openLoopback()
+//============================================================================
+{
+	if (!alcIsExtensionPresent(nullptr, "ALC_SOFT_loopback")) {
+		printf("AudioEngine: no loopback device (needs OpenAL Soft) - no sound\n");
+		return false;
+	}
+	LPALCLOOPBACKOPENDEVICESOFT openDevice =
+		(LPALCLOOPBACKOPENDEVICESOFT) alcGetProcAddress(nullptr, "alcLoopbackOpenDeviceSOFT");
+	device = openDevice ? openDevice(nullptr) : nullptr;
+	if (!device) {
+		printf("AudioEngine: can't open the loopback device - no sound\n");
+		return false;
+	}
+	ALCint attributes[] = {
+		ALC_FORMAT_CHANNELS_SOFT,	ALC_STEREO_SOFT,
+		ALC_FORMAT_TYPE_SOFT,		ALC_SHORT_SOFT,
+		ALC_FREQUENCY,					loopbackRate,
+		0
+	};
+	context = alcCreateContext(device, attributes);
+	// room for a tick (with plenty to spare, if the thread is late)
+	mix.resize(loopbackRate / 10 * 2);
+	return true;
+}
+
+void AudioEngine::
+stop()
+{
+	if (!running())
+		return;
+	stopping = true;
+	thread.join();
+
+	alcMakeContextCurrent(context);
+	for (int i = 0; i < voiceCount; i++) {
+		alSourceStop(voices[i].source);
+		alDeleteSources(1, &voices[i].source);
+		voices[i].source = 0;
+		voices[i].busy = false;
+	}
+	for (size_t i = 0; i < sounds.size(); i++)
+		alDeleteBuffers(1, &sounds[i].buffer);
+	alcMakeContextCurrent(nullptr);
+	alcDestroyContext(context);
+	alcCloseDevice(device);
+	context = nullptr;
+	device = nullptr;
+}
+
+//****************************************************************************
+//
+// * Queue a sound (any thread but one - see the header)
+//============================================================================
+bool AudioEngine::
+play(SoundId sound, const glm::vec3& position, float gain, float pitch, Priority priority)
+//============================================================================
+{
+	if (!running() || sound < 0 || sound >= (SoundId) sounds.size())
+		return false;
+	Command command;
+	command.type = Command::Play;
+	command.sound = sound;
+	command.priority = priority;
+	command.gain = gain;
+	command.pitch = pitch;
+	command.position = position;
+	if (!commands.push(std::move(command))) {
+		dropped_count++;
+		return false;
+	}
+	return true;
+}
+
+void AudioEngine::
+setListener(const glm::vec3& position, const glm::vec3& forward, const glm::vec3& up)
+{
+	if (!running())
+		return;
+	Command command;
+	command.type = Command::Listener;
+	command.position = position;
+	command.forward = forward;
+	command.up = up;
+	// if it doesn't fit, the next one will do
+	commands.push(std::move(command));
+}
+
+//****************************************************************************
+//
+// * The audio thread: apply the commands, free the voices that are done,
+//   and (loopback) mix the time that went by
+//============================================================================
+void AudioEngine::
+run()
+//============================================================================
+{
+	alcMakeContextCurrent(context);
+	LPALCRENDERSAMPLESSOFT renderSamples = loopback ?
+		(LPALCRENDERSAMPLESSOFT) alcGetProcAddress(device, "alcRenderSamplesSOFT") : nullptr;
+
+	std::chrono::steady_clock::time_point mixed = std::chrono::steady_clock::now();
+	while (!stopping) {
+		Command command;
+		while (commands.pop(command)) {
+			if (command.type == Command::Play)
+				playSound(command);
+			else {
+				ALfloat orientation[6] = {
+					command.forward.x, command.forward.y, command.forward.z,
+					command.up.x, command.up.y, command.up.z
+				};
+				alListener3f(AL_POSITION, command.position.x, command.position.y, command.position.z);
+				alListenerfv(AL_ORIENTATION, orientation);
+			}
+		}
+		reclaim();
+
+		if (renderSamples) {
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			long long due = std::chrono::duration_cast<std::chrono::microseconds>(now - mixed).count()
+				* loopbackRate / 1000000;
+			ALCsizei samples = (ALCsizei) std::min<long long>(due, (long long) mix.size() / 2);
+			if (samples > 0) {
+				renderSamples(device, &mix[0], samples);
+				mixed = now;
+			}
+		}
+		std::this_thread::sleep_for(tick);
+	}
+	alcMakeContextCurrent(nullptr);
+}
+
+//****************************************************************************
+//
+// * Give the sound a voice: a free one, or the oldest of the lowest
+//   priority not above its own. none of those - it isn't played
+//============================================================================
+void AudioEngine::
+playSound(const Command& command)
+//============================================================================
+{
+	Voice* chosen = nullptr;
+	for (int i = 0; i < voiceCount && !chosen; i++)
+		if (!voices[i].busy)
+			chosen = &voices[i];
+	if (!chosen) {
+		for (int i = 0; i < voiceCount; i++) {
+			Voice& voice = voices[i];
+			if (voice.priority > command.priority)
+				continue;
+			if (!chosen || voice.priority < chosen->priority ||
+				 (voice.priority == chosen->priority && voice.started < chosen->started))
+				chosen = &voice;
+		}
+		if (!chosen) {
+			dropped_count++;
+			return;
+		}
+		stolen_count++;
+		alSourceStop(chosen->source);
+	}
+
+	ALuint source = chosen->source;
+	alSourcei(source, AL_BUFFER, (ALint) sounds[command.sound].buffer);
+	alSource3f(source, AL_POSITION, command.position.x, command.position.y, command.position.z);
+	alSourcef(source, AL_GAIN, command.gain);
+	alSourcef(source, AL_PITCH, command.pitch);
+	alSourcePlay(source);
+
+	chosen->busy = true;
+	chosen->priority = command.priority;
+	chosen->started = voices_started++;
+}
+
+void AudioEngine::
+reclaim()
+{
+	for (int i = 0; i < voiceCount; i++) {
+		if (!voices[i].busy)
+			continue;
+		ALint state;
+		alGetSourcei(voices[i].source, AL_SOURCE_STATE, &state);
+		if (state != AL_PLAYING)
+			voices[i].busy = false;
+	}
+}
@@ -31,6 +31,7 @@
 #pragma warning(disable:4312)
 #pragma warning(disable:4311)
 #include <Fl/Fl_File_Chooser.H>
+#include <Fl/fl_ask.H>
 #include <Fl/math.h>
 #pragma warning(pop)
 
@@ -74,6 +75,7 @@ void addPointCB(Fl_Widget*, TrainWindow* tw)
 	Pnt3f npos = (tw->m_Track.points[previdx].pos + tw->m_Track.points[newidx].pos) * .5f;
 
 	tw->m_Track.points.insert(tw->m_Track.points.begin() + newidx,npos);
+	tw->m_Track.touch();
 
 	// make it so that the train doesn't move - unless its affected by this control point
 	// it should stay between the same points
@@ -97,6 +99,7 @@ void deletePointCB(Fl_Widget*, TrainWindow* tw)
 			tw->m_Track.points.erase(tw->m_Track.points.begin() + tw->trainView->selectedCube);
 		} else
 			tw->m_Track.points.pop_back();
+		tw->m_Track.touch();
 	}
 	tw->damageMe();
 }
@@ -151,9 +154,11 @@ void loadCB(Fl_Widget*, TrainWindow* tw)
 //===========================================================================
 {
 	const char* fname = 
-		fl_file_chooser("Pick a Track File","*.txt","TrackFiles/track.txt");
+		fl_file_chooser("Pick a Track File","*.{txt,trk}","TrackFiles/track.txt");
 	if (fname) {
-		tw->m_Track.readPoints(fname);
+		std::string error;
+		if (!tw->m_Track.readPoints(fname, error))
+			fl_alert("%s", error.c_str());
 		tw->damageMe();
 	}
 }
@@ -165,9 +170,25 @@ void saveCB(Fl_Widget*, TrainWindow* tw)
 //===========================================================================
 {
 	const char* fname = 
-		fl_input("File name for save (should be *.txt)","TrackFiles/");
-	if (fname)
-		tw->m_Track.writePoints(fname);
+		fl_input("File name for save (*.txt, or *.trk for binary)","TrackFiles/");
+	std::string error;
+	if (fname && !tw->m_Track.writePoints(fname, error))
+		fl_alert("%s", error.c_str());
+}
+
+//***************************************************************************
+//
+// * Write the GPU resources out, and their totals to the console
+//===========================================================================
+void gpuDumpCB(Fl_Widget*, TrainWindow*)
+//===========================================================================
+{
+	const char* path = "gpu_resources.json";
+	GpuResources::instance().print();
+	if (GpuResources::instance().writeJson(path))
+		printf("GPU resources written to %s\n", path);
+	else
+		fl_alert("Can't write %s", path);
 }
 
 //***************************************************************************
@@ -183,6 +204,7 @@ void rollx(TrainWindow* tw, float dir)
 		float co = cos(((float)M_PI_4) * dir);
 		tw->m_Track.points[s].orient.y = co * old.y - si * old.z;
 		tw->m_Track.points[s].orient.z = si * old.y + co * old.z;
+		tw->m_Track.touch();
 	}
 	tw->damageMe();
 } 
@@ -223,6 +245,7 @@ void rollz(TrainWindow* tw, float dir)
 
 		tw->m_Track.points[s].orient.y = co * old.y - si * old.x;
 		tw->m_Track.points[s].orient.x = si * old.y + co * old.x;
+		tw->m_Track.touch();
 	}
 
 	tw->damageMe();
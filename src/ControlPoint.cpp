@@ -31,13 +31,15 @@
 #include "ControlPoint.H"
 #include "Utilities/3dUtils.h"
 
+const float ControlPoint::size = 2.0f;
+
 //****************************************************************************
 //
 // * Default contructor
 //============================================================================
 ControlPoint::
 ControlPoint() 
-	: pos(0,0,0), orient(0,1,0)
+	: pos(0,0,0), orient(0,1,0), tag(0)
 //============================================================================
 {
 }
@@ -48,7 +50,7 @@ ControlPoint()
 //============================================================================
 ControlPoint::
 ControlPoint(const Pnt3f &_pos) 
-	: pos(_pos), orient(0,1,0)
+	: pos(_pos), orient(0,1,0), tag(0)
 //============================================================================
 {
 }
@@ -59,7 +61,7 @@ ControlPoint(const Pnt3f &_pos)
 //============================================================================
 ControlPoint::
 ControlPoint(const Pnt3f &_pos, const Pnt3f &_orient) 
-	: pos(_pos), orient(_orient)
+	: pos(_pos), orient(_orient), tag(0)
 //============================================================================
 {
 	orient.normalize();
@@ -73,8 +75,6 @@ void ControlPoint::
 draw()
 //============================================================================
 {
-	float size=2.0;
-
 	glPushMatrix();
 	glTranslatef(pos.x,pos.y,pos.z);
 	float theta1 = -radiansToDegrees(atan2(orient.z,orient.x));
@@ -130,4 +130,54 @@ draw()
 			glVertex3f( size, size , size);
 		glEnd();
 	glPopMatrix();
-}
\ No newline at end of file
+}
+
+//****************************************************************************
+//
+// * Triangles of the control point glyph (the same shape as draw)
+//============================================================================
+void ControlPoint::
+glyphTriangles(std::vector<float>& positions, std::vector<float>& normals)
+//============================================================================
+{
+	// the 5 sides of the box (no top - it will be the point), each as 
+	// a normal and 4 corners in the same order draw() uses
+	static const float quads[5][5][3] = {
+		{ { 0, 0, 1}, { 1, 1, 1}, {-1, 1, 1}, {-1,-1, 1}, { 1,-1, 1} },
+		{ { 0, 0,-1}, { 1, 1,-1}, { 1,-1,-1}, {-1,-1,-1}, {-1, 1,-1} },
+		{ { 0,-1, 0}, { 1,-1, 1}, {-1,-1, 1}, {-1,-1,-1}, { 1,-1,-1} },
+		{ { 1, 0, 0}, { 1, 1, 1}, { 1,-1, 1}, { 1,-1,-1}, { 1, 1,-1} },
+		{ {-1, 0, 0}, {-1, 1, 1}, {-1, 1,-1}, {-1,-1,-1}, {-1,-1, 1} }
+	};
+	// the triangle fan of the point: apex first, then the rim
+	static const float fan[6][2][3] = {
+		{ { 0, 1, 0}, { 0, 3, 0} },
+		{ { 1, 0, 1}, { 1, 1, 1} },
+		{ {-1, 0, 1}, {-1, 1, 1} },
+		{ {-1, 0,-1}, {-1, 1,-1} },
+		{ { 1, 0,-1}, { 1, 1,-1} },
+		{ { 1, 0, 1}, { 1, 1, 1} }
+	};
+
+	positions.clear();
+	normals.clear();
+
+	for (int q = 0; q < 5; ++q) {
+		static const int corners[6] = { 1, 2, 3, 1, 3, 4 };
+		for (int c = 0; c < 6; ++c) {
+			for (int k = 0; k < 3; ++k) {
+				positions.push_back(quads[q][corners[c]][k] * size);
+				normals.push_back(quads[q][0][k]);
+			}
+		}
+	}
+	for (int t = 1; t < 5; ++t) {
+		const int verts[3] = { 0, t, t + 1 };
+		for (int c = 0; c < 3; ++c) {
+			for (int k = 0; k < 3; ++k) {
+				positions.push_back(fan[verts[c]][1][k] * size);
+				normals.push_back(fan[verts[c]][0][k]);
+			}
+		}
+	}
+}
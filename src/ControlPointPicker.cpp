@@ -0,0 +1,254 @@
+/************************************************************************
+     File:        ControlPointPicker.cpp
+
+     Comment:     Picking control points without going through OpenGL
+
+						The mouse ray is tested against a bounding volume 
+						hierarchy over the control points (each one is 
+						wrapped in a sphere that holds the glyph no matter 
+						which way it points). The points whose boxes the
+						ray goes through are tested exactly: the ray is
+						turned into the point's own frame and tried against
+						the triangles of the glyph. Only the closest hit is
+						returned.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <algorithm>
+#include <math.h>
+
+#include "ControlPointPicker.H"
+#include "Track.H"
+
+// points per leaf - small enough that the leaf tests stay cheap
+static const int leafSize = 4;
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+ControlPointPicker::
+ControlPointPicker()
+	: radius(3.0f * ControlPoint::size), built(false), builtRevision(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * Make the next pick rebuild the hierarchy
+//============================================================================
+void ControlPointPicker::
+invalidate()
+//============================================================================
+{
+	built = false;
+}
+
+//****************************************************************************
+//
+// * Build the hierarchy over all the points of the track
+//============================================================================
+void ControlPointPicker::
+build(const CTrack& track)
+//============================================================================
+{
+	int npts = (int) track.points.size();
+
+	if (glyph.empty()) {
+		std::vector<float> positions, normals;
+		ControlPoint::glyphTriangles(positions, normals);
+		for (size_t i = 0; i + 2 < positions.size(); i += 3)
+			glyph.push_back(glm::vec3(positions[i], positions[i + 1], positions[i + 2]));
+	}
+
+	centers.resize(npts);
+	toLocal.resize(npts);
+	order.resize(npts);
+	for (int i = 0; i < npts; ++i) {
+		const Pnt3f& p = track.points[i].pos;
+		centers[i] = glm::vec3(p.x, p.y, p.z);
+		order[i] = i;
+
+		// the rotations of ControlPoint::draw - about y, then about z.
+		// a rotation's inverse is its transpose
+		const Pnt3f& o = track.points[i].orient;
+		float theta1 = -atan2f(o.z, o.x);
+		float theta2 = -acosf(std::min(std::max(o.y, -1.0f), 1.0f));
+		glm::mat3 rotateY(glm::vec3(cosf(theta1), 0, -sinf(theta1)),
+								glm::vec3(0, 1, 0),
+								glm::vec3(sinf(theta1), 0, cosf(theta1)));
+		glm::mat3 rotateZ(glm::vec3(cosf(theta2), sinf(theta2), 0),
+								glm::vec3(-sinf(theta2), cosf(theta2), 0),
+								glm::vec3(0, 0, 1));
+		toLocal[i] = glm::transpose(rotateY * rotateZ);
+	}
+
+	nodes.clear();
+	nodes.reserve(2 * (npts / leafSize + 1));
+	if (npts)
+		buildNode(0, npts);
+
+	built = true;
+	builtRevision = track.revision;
+}
+
+//****************************************************************************
+//
+// * Split the points at the median of the longest axis of their box
+//============================================================================
+int ControlPointPicker::
+buildNode(int first, int count)
+//============================================================================
+{
+	int index = (int) nodes.size();
+	nodes.push_back(Node());
+
+	glm::vec3 lo = centers[order[first]];
+	glm::vec3 hi = lo;
+	for (int i = first + 1; i < first + count; ++i) {
+		lo = glm::min(lo, centers[order[i]]);
+		hi = glm::max(hi, centers[order[i]]);
+	}
+	nodes[index].lo = lo - glm::vec3(radius);
+	nodes[index].hi = hi + glm::vec3(radius);
+
+	if (count <= leafSize) {
+		nodes[index].first = first;
+		nodes[index].count = count;
+		return index;
+	}
+
+	glm::vec3 extent = hi - lo;
+	int axis = 0;
+	if (extent.y > extent[axis]) axis = 1;
+	if (extent.z > extent[axis]) axis = 2;
+
+	int half = count / 2;
+	const std::vector<glm::vec3>& c = centers;
+	std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+		[&c, axis](int a, int b) { return c[a][axis] < c[b][axis]; });
+
+	buildNode(first, half);
+	int right = buildNode(first + half, count - half);
+
+	nodes[index].first = right;
+	nodes[index].count = 0;
+	return index;
+}
+
+//****************************************************************************
+//
+// * Ray against box - the slab test. invDir is 1/dir per axis
+//============================================================================
+static bool hitBox(const glm::vec3& lo, const glm::vec3& hi,
+						 const glm::vec3& origin, const glm::vec3& invDir, float maxT)
+//============================================================================
+{
+	float tmin = 0, tmax = maxT;
+	for (int a = 0; a < 3; ++a) {
+		float t1 = (lo[a] - origin[a]) * invDir[a];
+		float t2 = (hi[a] - origin[a]) * invDir[a];
+		if (t1 > t2) std::swap(t1, t2);
+		tmin = std::max(tmin, t1);
+		tmax = std::min(tmax, t2);
+		if (tmin > tmax)
+			return false;
+	}
+	return true;
+}
+
+//****************************************************************************
+//
+// * The ray in the point's frame, against each triangle of the glyph
+//   (Moller-Trumbore, both sides - the ray may start inside)
+//============================================================================
+float ControlPointPicker::
+hitGlyph(int point, const glm::vec3& origin, const glm::vec3& dir) const
+//============================================================================
+{
+	glm::vec3 o = toLocal[point] * (origin - centers[point]);
+	glm::vec3 d = toLocal[point] * dir;
+
+	float best = -1;
+	for (size_t i = 0; i + 2 < glyph.size(); i += 3) {
+		glm::vec3 e1 = glyph[i + 1] - glyph[i];
+		glm::vec3 e2 = glyph[i + 2] - glyph[i];
+		glm::vec3 p = glm::cross(d, e2);
+		float det = glm::dot(e1, p);
+		if (fabsf(det) < 1e-8f)
+			continue;
+		float inv = 1.0f / det;
+		glm::vec3 s = o - glyph[i];
+		float u = glm::dot(s, p) * inv;
+		if (u < 0 || u > 1)
+			continue;
+		glm::vec3 q = glm::cross(s, e1);
+		float v = glm::dot(d, q) * inv;
+		if (v < 0 || u + v > 1)
+			continue;
+		float t = glm::dot(e2, q) * inv;
+		if (t >= 0 && (best < 0 || t < best))
+			best = t;
+	}
+	return best;
+}
+
+//****************************************************************************
+//
+// * Walk the hierarchy: the spheres' boxes say which glyphs to try, and
+//   the closest glyph hit wins
+//============================================================================
+int ControlPointPicker::
+pick(const CTrack& track, const glm::vec3& origin, const glm::vec3& dir)
+//============================================================================
+{
+	if (!built || builtRevision != track.revision)
+		build(track);
+	if (nodes.empty())
+		return -1;
+
+	glm::vec3 invDir(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+	float r2 = radius * radius;
+
+	int best = -1;
+	float bestT = 1e30f;
+
+	int stack[64];
+	int top = 0;
+	stack[top++] = 0;
+	while (top) {
+		const Node& node = nodes[stack[--top]];
+		if (!hitBox(node.lo, node.hi, origin, invDir, bestT))
+			continue;
+
+		if (node.count) {
+			for (int i = node.first; i < node.first + node.count; ++i) {
+				glm::vec3 oc = origin - centers[order[i]];
+				float b = glm::dot(oc, dir);
+				float disc = b * b - (glm::dot(oc, oc) - r2);
+				if (disc < 0)
+					continue;
+				float s = sqrtf(disc);
+				// the sphere only bounds the glyph - nothing nearer than
+				// where the ray gets into it (0, starting inside)
+				if (-b + s < 0 || std::max(-b - s, 0.0f) >= bestT)
+					continue;
+				float t = hitGlyph(order[i], origin, dir);
+				if (t >= 0 && t < bestT) {
+					bestT = t;
+					best = order[i];
+				}
+			}
+		}
+		else {
+			int index = (int) (&node - &nodes[0]);
+			stack[top++] = node.first;
+			stack[top++] = index + 1;
+		}
+	}
+
+	return best;
+}
@@ -0,0 +1,160 @@
+/************************************************************************
+     File:        Fleet.cpp
+
+     Comment:     Boats going around the track, and their wakes
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <math.h>
+#include <algorithm>
+
+#include "Fleet.H"
+#include "WaterSurface.H"
+
+const float Fleet::length = 12.0f;
+const float Fleet::beam = 4.0f;
+
+// how far the hull goes down into the water, and up out of it
+static const float draught = 1.0f;
+static const float freeboard = 1.5f;
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+Fleet::
+Fleet()
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * Along the track by equal distances, then down (or up) onto the water
+//   - a boat stays level across, but follows the track's heading
+//============================================================================
+void Fleet::
+place(const TrackSpline& spline, float u, int count, const WaterSurface& water)
+//============================================================================
+{
+	vessels.resize(spline.segments() ? count : 0);
+	float spacing = vessels.empty() ? 0.0f : spline.length() / vessels.size();
+	float start = spline.distance(u);
+
+	for (size_t i = 0; i < vessels.size(); ++i) {
+		TrackSpline::Frame f = spline.frame(spline.parameter(start - i * spacing));
+		f.position.y = water.height(f.position.x, f.position.z);
+
+		glm::vec3 heading(f.tangent.x, 0, f.tangent.z);
+		if (glm::length(heading) < 1e-4f)
+			heading = glm::vec3(1, 0, 0);
+		f.tangent = glm::normalize(heading);
+		f.up = glm::vec3(0, 1, 0);
+		vessels[i] = f;
+	}
+}
+
+//============================================================================
+void Fleet::
+instances(std::vector<float>& out) const
+//============================================================================
+{
+	out.resize(vessels.size() * instanceFloats);
+	for (size_t i = 0; i < vessels.size(); ++i) {
+		const TrackSpline::Frame& f = vessels[i];
+		float* instance = &out[i * instanceFloats];
+		for (int k = 0; k < 3; ++k) {
+			instance[k] = f.position[k];
+			instance[3 + k] = f.tangent[k];
+			instance[6 + k] = f.up[k];
+		}
+	}
+}
+
+//****************************************************************************
+//
+// * The footprints: texture space has v going the other way from z, so
+//   the heading (x, z) is (x, -z) in it
+//============================================================================
+void Fleet::
+wakes(const WaterSurface& water, float strength, std::vector<float>& out) const
+//============================================================================
+{
+	out.clear();
+	if (strength <= 0)
+		return;
+	for (size_t i = 0; i < vessels.size(); ++i) {
+		const TrackSpline::Frame& f = vessels[i];
+		glm::vec2 uv;
+		if (!water.rippleCoord(f.position.x, f.position.z, uv))
+			continue;
+		glm::vec2 heading = glm::normalize(glm::vec2(f.tangent.x, -f.tangent.z));
+		out.push_back(uv.x);
+		out.push_back(uv.y);
+		out.push_back(heading.x);
+		out.push_back(heading.y);
+		out.push_back(strength);
+	}
+}
+
+//****************************************************************************
+//
+// * A punt with a pointed bow: the deck and the bottom, the sides and the
+//   transom, each a flat polygon (fanned into triangles) with the normal
+//   facing away from the middle
+//============================================================================
+void Fleet::
+hullTriangles(std::vector<float>& positions, std::vector<float>& normals)
+//============================================================================
+{
+	// x: -1 stern .. 1 bow, z: -1 port .. 1 starboard, in halves of the
+	// length and the beam
+	static const float corners[10][3] = {
+		{ -1.0f, 1, -1 }, { -1.0f, 1, 1 }, { 0.4f, 1, -1 }, { 0.4f, 1, 1 }, { 1.0f, 1, 0 },	// deck
+		{ -0.9f, 0, -0.6f }, { -0.9f, 0, 0.6f }, { 0.4f, 0, -0.6f }, { 0.4f, 0, 0.6f }, { 0.85f, 0, 0 }	// bottom
+	};
+	// -1 ends a polygon
+	static const int polygons[] = {
+		0, 1, 3, 2, -1,		2, 3, 4, -1,			// deck
+		5, 7, 8, 6, -1,		7, 9, 8, -1,			// bottom
+		0, 2, 7, 5, -1,		2, 4, 9, 7, -1,		// port side and bow
+		1, 6, 8, 3, -1,		3, 8, 9, 4, -1,		// starboard
+		0, 5, 6, 1, -1									// transom
+	};
+
+	glm::vec3 points[10];
+	for (int i = 0; i < 10; ++i) {
+		float up = corners[i][1] > 0 ? freeboard : -draught;
+		points[i] = glm::vec3(corners[i][0] * length / 2, up, corners[i][2] * beam / 2);
+	}
+	glm::vec3 middle(0, (freeboard - draught) / 2, 0);
+
+	positions.clear();
+	normals.clear();
+	int count = sizeof(polygons) / sizeof(polygons[0]);
+	for (int first = 0; first < count; ) {
+		int end = first;
+		while (polygons[end] >= 0)
+			++end;
+
+		const glm::vec3& a = points[polygons[first]];
+		glm::vec3 normal = glm::normalize(glm::cross(points[polygons[first + 1]] - a, points[polygons[first + 2]] - a));
+		bool flip = glm::dot(normal, a - middle) < 0;
+		if (flip)
+			normal = -normal;
+
+		for (int k = first + 1; k + 1 < end; ++k) {
+			int fan[3] = { polygons[first], polygons[k], polygons[k + 1] };
+			if (flip)
+				std::swap(fan[1], fan[2]);
+			for (int c = 0; c < 3; ++c)
+				for (int axis = 0; axis < 3; ++axis) {
+					positions.push_back(points[fan[c]][axis]);
+					normals.push_back(normal[axis]);
+				}
+		}
+		first = end + 1;
+	}
+}
@@ -0,0 +1,366 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <filesystem>
+#include <system_error>
+
+#include "TextureImporter.h"
+#include "GpuResources.h"
+
+// Every texture loaded from a file goes through here, so each one is only
+// decoded and uploaded once:
+//  - an asset is found again by its path(s) and import options,
+//  - or, failing that, by the hash of the file contents (the same image
+//    under another name). only files the same size as ones already loaded
+//    are hashed (and those only once), so a cold start doesn't read every
+//    image twice,
+//  - textures are reference counted. one nobody uses stays loaded (in case
+//    it is asked for again) until the memory budget needs the room, then
+//    the least recently used goes first
+class AssetManager
+{
+public:
+	struct Stats
+	{
+		unsigned int hits = 0;			// found by path and options
+		unsigned int shared = 0;		// another path, but the same contents
+		unsigned int misses = 0;		// had to be decoded and uploaded
+		unsigned int evictions = 0;		// unused, and dropped for the budget
+		size_t textures_resident = 0;
+		size_t bytes_resident = 0;		// estimated video memory
+	};
+
+	static AssetManager& instance()
+	{
+		static AssetManager manager;
+		return manager;
+	}
+
+	// a 2D texture. if the image is already decoded, pass it in - it is
+	// only used when the texture isn't loaded yet
+	GLuint acquireTexture(const char* path, TextureImporter::Format format,
+		glm::ivec2* size = nullptr, const cv::Mat* decoded = nullptr)
+	{
+		std::string options = "2d:" + std::to_string((int)format) + ":";
+		std::string key = options + path;
+
+		Entry* entry = findKey(key);
+		std::string sizes;
+		if (entry)
+			this->counts.hits++;
+		else if ((entry = findContent(sizes = sizeKey(options, &path, 1), &path, 1, key)))
+			this->counts.shared++;
+		else
+		{
+			glm::ivec2 dims(0, 0);
+			GLuint id;
+			if (decoded && !decoded->empty())
+			{
+				id = TextureImporter::upload(*decoded, format, path);
+				dims = glm::ivec2(decoded->cols, decoded->rows);
+			}
+			else
+				id = TextureImporter::load(path, format, &dims);
+			if (!id)
+				return 0;
+
+			this->counts.misses++;
+			entry = add(id, key, sizes, &path, 1, dims,
+				TextureImporter::storageBytes(format, dims.x, dims.y));
+			GpuResources::instance().texture(id, "assets", path, TextureImporter::internalFormat(format),
+				dims.x, dims.y, 1, TextureImporter::levelCount(dims.x, dims.y));
+		}
+
+		if (size)
+			*size = entry->size;
+		return use(entry);
+	}
+
+	// a cubemap from six faces (+x, -x, +y, -y, +z, -z), or one baked .dds 
+	// cubemap (see TextureImporter::loadCubemap)
+	GLuint acquireCubemap(const std::vector<const char*>& faces,
+		TextureImporter::Format format = TextureImporter::FORMAT_BC1, int* size = nullptr)
+	{
+		std::string options = "cube:" + std::to_string((int)format) + ":";
+		std::string key = options;
+		for (size_t i = 0; i < faces.size(); i++)
+			key += std::string(faces[i]) + "|";
+
+		Entry* entry = findKey(key);
+		std::string sizes;
+		if (entry)
+			this->counts.hits++;
+		else if ((entry = findContent(sizes = sizeKey(options, &faces[0], faces.size()), &faces[0], faces.size(), key)))
+			this->counts.shared++;
+		else
+		{
+			int width = 0;
+			GLuint id = TextureImporter::loadCubemap(faces, format, &width);
+			if (!id)
+				return 0;
+
+			this->counts.misses++;
+			entry = add(id, key, sizes, &faces[0], faces.size(), glm::ivec2(width, width),
+				6 * TextureImporter::storageBytes(format, width, width));
+			GpuResources::instance().texture(id, "assets", faces[0], TextureImporter::internalFormat(format),
+				width, width, 6, TextureImporter::levelCount(width, width));
+		}
+		if (size)
+			*size = entry->size.x;
+		return use(entry);
+	}
+
+	// give back a texture from acquire
+	void release(GLuint id)
+	{
+		std::map<GLuint, Entry*>::iterator found = this->by_id.find(id);
+		if (found == this->by_id.end())
+			return;
+		Entry* entry = found->second;
+		if (--entry->refs == 0)
+		{
+			this->unused.push_front(entry);
+			entry->lru = this->unused.begin();
+			evict();
+		}
+	}
+
+	// trade a 2D texture for a copy without its biggest level, to save
+	// memory (see TextureImporter::dropTopLevel). the old id is deleted -
+	// whoever holds it takes the one returned (the same, if it can't be
+	// made any smaller)
+	GLuint reduce(GLuint id)
+	{
+		std::map<GLuint, Entry*>::iterator found = this->by_id.find(id);
+		if (found == this->by_id.end())
+			return id;
+		glm::ivec2 size;
+		GLenum format;
+		int levels;
+		GLuint smaller = TextureImporter::dropTopLevel(id, &size, &format, &levels);
+		if (!smaller)
+			return id;
+
+		Entry* entry = found->second;
+		this->by_id.erase(found);
+		glDeleteTextures(1, &id);
+		GpuResources::instance().forget(GpuResources::KIND_TEXTURE, id);
+		GpuResources::instance().texture(smaller, "assets", entry->name, format, size.x, size.y, 1, levels);
+
+		size_t bytes = GpuResources::textureBytes(format, size.x, size.y, 1, levels);
+		this->counts.bytes_resident = this->counts.bytes_resident - entry->bytes + bytes;
+		entry->bytes = bytes;
+		entry->size = size;
+		entry->id = smaller;
+		this->by_id[smaller] = entry;
+		return smaller;
+	}
+
+	// how many bytes the textures may take before unused ones get dropped
+	void setBudget(size_t bytes)
+	{
+		this->budget = bytes;
+		evict();
+	}
+
+	const Stats& stats() const
+	{
+		return this->counts;
+	}
+
+	void printStats() const
+	{
+		printf("Assets: %u hits, %u shared, %u misses, %u evictions, %u textures, %.1f MB\n",
+			this->counts.hits, this->counts.shared, this->counts.misses, this->counts.evictions,
+			(unsigned int)this->counts.textures_resident, this->counts.bytes_resident / (1024.0 * 1024.0));
+	}
+
+private:
+	struct Entry
+	{
+		GLuint id;
+		std::vector<std::string> keys;	// every path+options it was asked for by
+		std::vector<std::string> files;	// what it was loaded from
+		std::string sizes;				// options+file sizes ("" - not matched by contents)
+		std::string content;			// options+file hashes, once something had to compare
+		std::string name;				// the (first) file, for GpuResources
+		glm::ivec2 size;
+		size_t bytes;
+		int refs;
+		std::list<Entry*>::iterator lru;	// where it is in unused (refs == 0)
+		std::multimap<std::string, Entry*>::iterator by_size;	// (if sizes isn't "")
+	};
+
+	AssetManager() {}
+
+	Entry* findKey(const std::string& key)
+	{
+		std::map<std::string, Entry*>::iterator found = this->by_key.find(key);
+		return (found == this->by_key.end()) ? nullptr : found->second;
+	}
+
+	// the same contents under another key - remember the new key too.
+	// only the entries whose files are the same sizes can be, so only
+	// those (and these files) are hashed
+	Entry* findContent(const std::string& sizes, const char* const* paths, size_t count, const std::string& key)
+	{
+		if (sizes.empty())
+			return nullptr;
+		std::string content;
+		typedef std::multimap<std::string, Entry*>::iterator Iterator;
+		std::pair<Iterator, Iterator> range = this->by_size.equal_range(sizes);
+		for (Iterator it = range.first; it != range.second; ++it)
+		{
+			Entry* other = it->second;
+			if (content.empty() && (content = contentKey(sizes, paths, count)).empty())
+				return nullptr;
+			if (other->content.empty())
+			{
+				std::vector<const char*> files;
+				for (size_t i = 0; i < other->files.size(); i++)
+					files.push_back(other->files[i].c_str());
+				other->content = contentKey(sizes, &files[0], files.size());
+			}
+			if (other->content == content)
+			{
+				other->keys.push_back(key);
+				this->by_key[key] = other;
+				return other;
+			}
+		}
+		return nullptr;
+	}
+
+	Entry* add(GLuint id, const std::string& key, const std::string& sizes, const char* const* paths, size_t count,
+		const glm::ivec2& size, size_t bytes)
+	{
+		Entry* entry = new Entry;
+		entry->id = id;
+		entry->keys.push_back(key);
+		entry->files.assign(paths, paths + count);
+		entry->sizes = sizes;
+		entry->name = paths[0];
+		entry->size = size;
+		entry->bytes = bytes;
+		entry->refs = 0;
+		entry->lru = this->unused.end();
+
+		this->by_key[key] = entry;
+		if (!sizes.empty())
+			entry->by_size = this->by_size.insert(std::make_pair(sizes, entry));
+		this->by_id[id] = entry;
+		this->counts.textures_resident++;
+		this->counts.bytes_resident += bytes;
+		return entry;
+	}
+
+	GLuint use(Entry* entry)
+	{
+		if (entry->refs++ == 0 && entry->lru != this->unused.end())
+		{
+			this->unused.erase(entry->lru);
+			entry->lru = this->unused.end();
+		}
+		evict();
+		return entry->id;
+	}
+
+	// drop unused textures, oldest first, until we fit the budget
+	void evict()
+	{
+		while (this->counts.bytes_resident > this->budget && !this->unused.empty())
+		{
+			Entry* entry = this->unused.back();
+			this->unused.pop_back();
+
+			for (size_t i = 0; i < entry->keys.size(); i++)
+				this->by_key.erase(entry->keys[i]);
+			if (!entry->sizes.empty())
+				this->by_size.erase(entry->by_size);
+			this->by_id.erase(entry->id);
+			glDeleteTextures(1, &entry->id);
+			GpuResources::instance().forget(GpuResources::KIND_TEXTURE, entry->id);
+
+			this->counts.textures_resident--;
+			this->counts.bytes_resident -= entry->bytes;
+			this->counts.evictions++;
+			delete entry;
+		}
+	}
+
+	// options and the sizes of the files - what has to match before the
+	// contents are worth comparing. a file that isn't there can't be
+	// matched by its contents ("")
+	static std::string sizeKey(const std::string& options, const char* const* paths, size_t count)
+	{
+		std::string sizes = options;
+		for (size_t i = 0; i < count; i++)
+		{
+			std::error_code error;
+			uintmax_t bytes = std::filesystem::file_size(paths[i], error);
+			if (error)
+				return "";
+			sizes += std::to_string(bytes) + ";";
+		}
+		return sizes;
+	}
+
+	// the sizes and the hashes of the files ("" if one can't be read)
+	static std::string contentKey(const std::string& sizes, const char* const* paths, size_t count)
+	{
+		std::string content = sizes;
+		std::map<std::string, uint64_t> read;
+		for (size_t i = 0; i < count; i++)
+		{
+			std::map<std::string, uint64_t>::iterator found = read.find(paths[i]);
+			uint64_t hash = (found != read.end()) ? found->second : (read[paths[i]] = hashFile(paths[i]));
+			if (!hash)
+				return "";
+			content += hashString(hash);
+		}
+		return content;
+	}
+
+	// FNV-1a of the whole file (0 if it can't be read)
+	static uint64_t hashFile(const char* path)
+	{
+		FILE* file = fopen(path, "rb");
+		if (!file)
+			return 0;
+		uint64_t hash = 14695981039346656037ULL;
+		unsigned char buffer[65536];
+		size_t got;
+		while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0)
+			for (size_t i = 0; i < got; i++)
+			{
+				hash ^= buffer[i];
+				hash *= 1099511628211ULL;
+			}
+		fclose(file);
+		return hash;
+	}
+
+	static std::string hashString(uint64_t hash)
+	{
+		char text[17];
+		sprintf(text, "%016llx", (unsigned long long)hash);
+		return text;
+	}
+
+private:
+	std::map<std::string, Entry*> by_key;
+	std::multimap<std::string, Entry*> by_size;
+	std::map<GLuint, Entry*> by_id;
+	std::list<Entry*> unused;	// front is the most recently released
+
+	size_t budget = (size_t)512 * 1024 * 1024;
+	Stats counts;
+};
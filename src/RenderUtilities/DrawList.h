@@ -0,0 +1,332 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <new>
+#include <type_traits>
+
+#include "FrameArena.h"
+#include "StateCache.h"
+
+// Draws are recorded instead of issued: each item carries the state it
+// needs (program, vertex array, textures, depth/cull/blend) and a 64 bit
+// sort key, and execute sorts the items and runs them through the state
+// cache. items that share a program and material end up next to each
+// other, so the cost grows with the number of different states, not the
+// number of things drawn.
+//
+// the key, high bits first:
+//	pass (4) | distance band (6) | program (12) | material (16) |
+//	distance (14) | order (12)
+// the bands are log spaced, so within a pass things go roughly front to
+// back (nearer things hide more) and, among things about as far away,
+// grouped by state. blended items have to go strictly back to front, so
+// theirs puts the (inverted) distance above the state:
+//	pass (4) | distance band (6) | distance (14) | program (12) |
+//	material (16) | order (12)
+class DrawList
+{
+public:
+	// the passes go in this order
+	enum Pass {
+		PASS_DEPTH = 0,			// depth only (no color) - the prepass
+		PASS_WATER = 1,			// the water covers most of the pool, so first
+		PASS_OPAQUE = 2,
+		PASS_BACKGROUND = 3,	// on the far plane, where nothing else was drawn
+	};
+
+	static const int maxTextures = 12;
+	static const int maxSamplers = 16;
+	static constexpr float maxDistance = 2000.0f;	// depths past it all sort the same
+
+	struct Texture
+	{
+		int unit;
+		GLenum target;
+		GLuint id;
+	};
+
+	// a sampler uniform and the unit it reads (a literal - it is kept)
+	struct Sampler
+	{
+		const char* name;
+		int unit;
+	};
+
+	// everything an item needs set before it draws - one of these is
+	// usually shared by every item of a kind (the material)
+	struct State
+	{
+		GLuint program = 0;
+		GLuint vertex_array = 0;
+		int texture_count = 0;
+		Texture textures[maxTextures];
+		bool depth_test = true;
+		bool depth_write = true;
+		bool color_write = true;
+		GLenum depth_func = GL_LESS;
+		bool cull = false;
+		GLenum cull_face = GL_BACK;
+		GLenum front_face = GL_CCW;
+		bool blend = false;
+		GLenum blend_src = GL_SRC_ALPHA;
+		GLenum blend_dst = GL_ONE_MINUS_SRC_ALPHA;
+		// set once when the state is applied, not by every item
+		int sampler_count = 0;
+		Sampler samplers[maxSamplers];
+		// which material this is this frame (set by material)
+		unsigned int id = 0;
+
+		void addTexture(int unit, GLenum target, GLuint id)
+		{
+			Texture texture = { unit, target, id };
+			this->textures[this->texture_count++] = texture;
+		}
+
+		void addSampler(const char* name, int unit)
+		{
+			Sampler sampler = { name, unit };
+			this->samplers[this->sampler_count++] = sampler;
+		}
+	};
+
+	struct Item
+	{
+		uint64_t key;
+		const State* state;
+		void (*setup)(const void*);		// sets the item's uniforms
+		const void* setup_data;
+		GLenum mode;
+		GLint first;
+		GLsizei count;
+		GLsizei instances;				// 0 is a plain (not instanced) draw
+	};
+
+	DrawList()
+	{
+		this->items.reserve(256);
+		this->materials.reserve(64);
+	}
+
+	// the start of a frame: everything recorded last frame is dropped
+	void newFrame()
+	{
+		this->items.clear();
+		this->materials.clear();
+		this->arena.reset();
+	}
+
+	FrameArena& frameArena()
+	{
+		return this->arena;
+	}
+
+	// the frame's copy of state: a state equal to one already asked for
+	// this frame gets that one back, so every item drawn the same way
+	// shares one material (and one id in the key). a frame has a handful,
+	// so they are searched in order, by hash first
+	const State* material(const State& state)
+	{
+		uint32_t hash = hashOf(state);
+		for (size_t i = 0; i < this->materials.size(); i++)
+		{
+			if (this->materials[i].hash == hash && same(*this->materials[i].state, state))
+				return this->materials[i].state;
+		}
+
+		State* copy = this->arena.allocate<State>();
+		memcpy(copy, &state, sizeof(State));
+		copy->id = (unsigned int)this->materials.size();
+		Material material = { copy, hash };
+		this->materials.push_back(material);
+		return copy;
+	}
+
+	// record a draw. setup is called (with the program in use) just before
+	// it draws, to set its uniforms - it is kept until the end of the frame,
+	// so it may only capture things that need no destructor
+	template <class F>
+	void submit(Pass pass, const State* state, float distance,
+		GLenum mode, GLint first, GLsizei count, F setup, GLsizei instances = 0)
+	{
+		static_assert(std::is_trivially_destructible<F>::value, "draw setup must not need a destructor");
+		F* data = new (this->arena.allocate(sizeof(F), alignof(F))) F(setup);
+
+		Item item;
+		item.key = makeKey(pass, state, distance);
+		item.state = state;
+		item.setup = &call<F>;
+		item.setup_data = data;
+		item.mode = mode;
+		item.first = first;
+		item.count = count;
+		item.instances = instances;
+		this->items.push_back(item);
+	}
+
+	// sort what was recorded, draw it, and start over (the frame's memory
+	// stays until newFrame)
+	void execute()
+	{
+		std::sort(this->items.begin(), this->items.end(),
+			[](const Item& a, const Item& b) { return a.key < b.key; });
+
+		StateCache& cache = StateCache::instance();
+		const State* last = nullptr;
+		for (size_t i = 0; i < this->items.size(); i++)
+		{
+			const Item& item = this->items[i];
+			if (item.state != last)
+			{
+				apply(cache, *item.state);
+				last = item.state;
+			}
+			item.setup(item.setup_data);
+			if (item.instances)
+				glDrawArraysInstanced(item.mode, item.first, item.count, item.instances);
+			else
+				glDrawArrays(item.mode, item.first, item.count);
+		}
+		// glClear obeys the masks, so don't leave them off
+		cache.depthMask(true);
+		cache.colorMask(true);
+		this->items.clear();
+		this->sequence = 0;
+	}
+
+	size_t size() const
+	{
+		return this->items.size();
+	}
+
+private:
+	template <class F>
+	static void call(const void* data)
+	{
+		(*static_cast<const F*>(data))();
+	}
+
+	uint64_t makeKey(Pass pass, const State* state, float distance)
+	{
+		float clamped = std::min(std::max(distance, 0.0f), maxDistance);
+		uint64_t band = (uint64_t)(log2f(1.0f + clamped) / log2f(1.0f + maxDistance) * 63.0f);
+		uint64_t depth = (uint64_t)(clamped / maxDistance * 0x3fff);
+		if (state->blend)
+		{
+			band = 63 - band;	// back to front
+			depth = 0x3fff - depth;
+		}
+
+		uint64_t material = state->id & 0xffff;
+		uint64_t program = state->program & 0xfff;
+
+		if (state->blend)
+			return ((uint64_t)(pass & 0xf) << 60) |
+				(band << 54) |
+				(depth << 40) |
+				(program << 28) |
+				(material << 12) |
+				(uint64_t)(this->sequence++ & 0xfff);
+		return ((uint64_t)(pass & 0xf) << 60) |
+			(band << 54) |
+			(program << 42) |
+			(material << 26) |
+			(depth << 12) |
+			(uint64_t)(this->sequence++ & 0xfff);
+	}
+
+	// the state cache skips whatever the last item already set
+	static void apply(StateCache& cache, const State& state)
+	{
+		cache.useProgram(state.program);
+		for (int i = 0; i < state.sampler_count; i++)
+			glUniform1i(glGetUniformLocation(state.program, state.samplers[i].name), state.samplers[i].unit);
+		cache.bindVertexArray(state.vertex_array);
+		for (int i = 0; i < state.texture_count; i++)
+			cache.bindTexture(state.textures[i].unit, state.textures[i].target, state.textures[i].id);
+		cache.setEnabled(GL_DEPTH_TEST, state.depth_test);
+		cache.depthMask(state.depth_write);
+		cache.colorMask(state.color_write);
+		cache.depthFunc(state.depth_func);
+		cache.setEnabled(GL_CULL_FACE, state.cull);
+		if (state.cull)
+		{
+			cache.cullFace(state.cull_face);
+			cache.frontFace(state.front_face);
+		}
+		cache.setEnabled(GL_BLEND, state.blend);
+		if (state.blend)
+			cache.blendFunc(state.blend_src, state.blend_dst);
+	}
+
+	// FNV-1a over what same compares
+	static void mix(uint32_t& hash, uint32_t value)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			hash ^= (value >> (i * 8)) & 0xff;
+			hash *= 16777619u;
+		}
+	}
+
+	static uint32_t hashOf(const State& state)
+	{
+		uint32_t hash = 2166136261u;
+		mix(hash, state.program);
+		mix(hash, state.vertex_array);
+		for (int i = 0; i < state.texture_count; i++)
+		{
+			mix(hash, state.textures[i].unit);
+			mix(hash, state.textures[i].target);
+			mix(hash, state.textures[i].id);
+		}
+		mix(hash, state.depth_test | state.depth_write << 1 | state.color_write << 2 | state.cull << 3 | state.blend << 4);
+		mix(hash, state.depth_func);
+		mix(hash, state.cull_face);
+		mix(hash, state.front_face);
+		mix(hash, state.blend_src);
+		mix(hash, state.blend_dst);
+		for (int i = 0; i < state.sampler_count; i++)
+			mix(hash, state.samplers[i].unit);
+		return hash;
+	}
+
+	// field by field (the padding of a State isn't set)
+	static bool same(const State& a, const State& b)
+	{
+		if (a.program != b.program || a.vertex_array != b.vertex_array ||
+			a.texture_count != b.texture_count || a.sampler_count != b.sampler_count ||
+			a.depth_test != b.depth_test || a.depth_write != b.depth_write ||
+			a.color_write != b.color_write || a.depth_func != b.depth_func ||
+			a.cull != b.cull || a.cull_face != b.cull_face || a.front_face != b.front_face ||
+			a.blend != b.blend || a.blend_src != b.blend_src || a.blend_dst != b.blend_dst)
+			return false;
+		for (int i = 0; i < a.texture_count; i++)
+		{
+			if (a.textures[i].unit != b.textures[i].unit || a.textures[i].target != b.textures[i].target ||
+				a.textures[i].id != b.textures[i].id)
+				return false;
+		}
+		for (int i = 0; i < a.sampler_count; i++)
+		{
+			if (a.samplers[i].unit != b.samplers[i].unit || strcmp(a.samplers[i].name, b.samplers[i].name))
+				return false;
+		}
+		return true;
+	}
+
+	struct Material
+	{
+		const State* state;
+		uint32_t hash;
+	};
+
+	std::vector<Item> items;
+	std::vector<Material> materials;
+	FrameArena arena;
+	unsigned int sequence = 0;
+};
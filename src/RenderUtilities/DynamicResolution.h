@@ -0,0 +1,125 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <algorithm>
+
+// Picks how much of the window's resolution the scene is rendered at, from
+// how long the GPU took to draw the scene in the last frames:
+//  - begin/end put a timer query around the scene. the results are read
+//    a few frames late, when they are ready, so nothing waits on the GPU
+//  - the time is smoothed, and the scale moved towards what would fit the
+//    budget (the cost goes with the pixel count - the scale squared),
+//    in steps, and not more often than every few frames, so it doesn't
+//    flicker between two sizes
+// the render targets stay at the window size; the scene only uses the
+// corner of them that size() says
+class DynamicResolution
+{
+public:
+	static constexpr float minScale = 0.5f;
+	static constexpr float maxScale = 1.0f;
+
+	// the GPU time the scene may take, in milliseconds (0: always full size)
+	void setBudget(float ms)
+	{
+		this->budget_ms = ms;
+		if (ms <= 0.0f)
+			this->current = maxScale;
+	}
+
+	void begin()
+	{
+		if (!this->queries[0])
+			glGenQueries(queryCount, this->queries);
+		collect();
+		// every query still waiting for its result: skip timing this frame
+		if (this->waiting[this->next])
+			return;
+		glBeginQuery(GL_TIME_ELAPSED, this->queries[this->next]);
+		this->timing = true;
+	}
+
+	void end()
+	{
+		if (!this->timing)
+			return;
+		glEndQuery(GL_TIME_ELAPSED);
+		this->waiting[this->next] = true;
+		this->next = (this->next + 1) % queryCount;
+		this->timing = false;
+	}
+
+	float scale() const
+	{
+		return this->current;
+	}
+
+	// the size to render at, for a window of width x height
+	glm::ivec2 size(int width, int height) const
+	{
+		return glm::ivec2(std::max(1, (int)(width * this->current + 0.5f)),
+			std::max(1, (int)(height * this->current + 0.5f)));
+	}
+
+	// the smoothed time of the scene
+	float gpuMs() const
+	{
+		return this->smoothed_ms;
+	}
+
+private:
+	static const int queryCount = 4;
+	static const int settleFrames = 8;		// frames between changes
+	static constexpr float step = 0.05f;	// the scale moves in these
+
+	// read every result that is ready, oldest first
+	void collect()
+	{
+		for (int i = 0; i < queryCount; i++)
+		{
+			int slot = (this->next + i) % queryCount;
+			if (!this->waiting[slot])
+				continue;
+			GLint ready = 0;
+			glGetQueryObjectiv(this->queries[slot], GL_QUERY_RESULT_AVAILABLE, &ready);
+			if (!ready)
+				break;
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(this->queries[slot], GL_QUERY_RESULT, &ns);
+			this->waiting[slot] = false;
+			measured(ns / 1.0e6f);
+		}
+	}
+
+	void measured(float ms)
+	{
+		this->smoothed_ms = this->smoothed_ms > 0.0f ? this->smoothed_ms * 0.9f + ms * 0.1f : ms;
+		if (this->budget_ms <= 0.0f || ++this->since_change < settleFrames)
+			return;
+
+		// the scale the budget would allow, if the time goes with the pixels
+		float wanted = this->current * sqrtf(this->budget_ms / std::max(this->smoothed_ms, 0.01f));
+		wanted = std::min(std::max(wanted, minScale), maxScale);
+		// a bit of room either side, so it settles
+		if (wanted < this->current - step * 0.5f || (wanted > this->current + step && this->current < maxScale))
+		{
+			float moved = this->current + std::min(std::max(wanted - this->current, -2 * step), step);
+			this->current = std::min(std::max(roundf(moved / step) * step, minScale), maxScale);
+			this->since_change = 0;
+			// the old times were for the other size
+			this->smoothed_ms = 0.0f;
+		}
+	}
+
+	GLuint queries[queryCount] = { 0 };
+	bool waiting[queryCount] = { false };
+	int next = 0;
+	bool timing = false;
+
+	float budget_ms = 0.0f;
+	float current = maxScale;
+	float smoothed_ms = 0.0f;
+	int since_change = 0;
+};
@@ -0,0 +1,232 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <future>
+
+#include "Shader.h"
+#include "TextureImporter.h"
+#include "GpuResources.h"
+#include "ThreadPool.h"
+
+// Image based lighting from the skybox, split sum style:
+//  - prefiltered: the skybox convolved with the GGX lobe, one roughness per
+//    mip level (roughness = level / (levelCount - 1)), so a glossy
+//    reflection is one textureLod
+//  - brdf_lut: the scale (r) and bias (g) on F0 for n.v (s) and roughness (t)
+// the cubemap is filtered on the GPU, the table on the CPU threads. both
+// are kept in the texture cache and only made again when the skybox changes
+class EnvironmentMap
+{
+public:
+	static const int size = 128;		// width of the top level
+	static const int levelCount = 6;	// 128 down to 4
+	static const int lutSize = 128;
+
+	GLuint prefiltered = 0;
+	GLuint brdf_lut = 0;
+
+	// skybox is the cubemap, faces what it was loaded from (for the cache)
+	void build(GLuint skybox, int skybox_size, const std::vector<const char*>& faces)
+	{
+		std::string cache = TextureImporter::cubeCachePath(faces, TextureImporter::FORMAT_RGBA8) + ".ggx.dds";
+		if (TextureImporter::fresh(cache, &faces[0], faces.size()))
+			this->prefiltered = TextureImporter::loadCubemap(std::vector<const char*>(1, cache.c_str()), TextureImporter::FORMAT_RGBA8);
+		if (!this->prefiltered)
+			prefilter(skybox, skybox_size, cache);
+
+		std::vector<float> lut;
+		std::string lut_cache = TextureImporter::cacheDir() + "/brdf_lut.bin";
+		if (!readLUT(lut_cache, lut))
+		{
+			integrateBRDF(lut);
+			writeLUT(lut_cache, lut);
+		}
+		glGenTextures(1, &this->brdf_lut);
+		glBindTexture(GL_TEXTURE_2D, this->brdf_lut);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG16F, lutSize, lutSize);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, lutSize, lutSize, GL_RG, GL_FLOAT, &lut[0]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		GpuResources::instance().texture(this->prefiltered, "environment", "prefiltered skybox", GL_RGBA8, size, size, 6, levelCount);
+		GpuResources::instance().texture(this->brdf_lut, "environment", "brdf table", GL_RG16F, lutSize, lutSize);
+	}
+
+private:
+	// render every level of every face, then read it back for the cache
+	void prefilter(GLuint skybox, int skybox_size, const std::string& cache)
+	{
+		Shader shader("src/shaders/prefilter.vert", nullptr, nullptr, nullptr, "src/shaders/prefilter.frag");
+
+		glGenTextures(1, &this->prefiltered);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, this->prefiltered);
+		glTexStorage2D(GL_TEXTURE_CUBE_MAP, levelCount, GL_RGBA8, size, size);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		GLuint fbo, vao;
+		glGenFramebuffers(1, &fbo);
+		glGenVertexArrays(1, &vao);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glBindVertexArray(vao);
+		glDisable(GL_DEPTH_TEST);
+		glDisable(GL_BLEND);
+		glDisable(GL_CULL_FACE);
+		glDisable(GL_STENCIL_TEST);
+
+		shader.Use();
+		shader.setInt("u_source", 0);
+		glUniform1f(glGetUniformLocation(shader.Program, "u_source_size"), (float)skybox_size);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, skybox);
+		for (int level = 0; level < levelCount; level++)
+		{
+			int width = size >> level;
+			glViewport(0, 0, width, width);
+			glUniform1f(glGetUniformLocation(shader.Program, "u_roughness"), (float)level / (levelCount - 1));
+			glUniform1f(glGetUniformLocation(shader.Program, "u_base_lod"), std::max(0.0f, log2f((float)skybox_size / width)));
+			for (int face = 0; face < 6; face++)
+			{
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, this->prefiltered, level);
+				shader.setInt("u_face", face);
+				glDrawArrays(GL_TRIANGLES, 0, 3);
+			}
+		}
+
+		glBindVertexArray(0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteVertexArrays(1, &vao);
+		glDeleteFramebuffers(1, &fbo);
+		// the program is going away - the cache mustn't think it is still
+		// in use (a new one could get the same name)
+		StateCache::instance().useProgram(0);
+		glDeleteProgram(shader.Program);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		glEnable(GL_DEPTH_TEST);
+
+		// it only happens when the skybox changes, so just wait for it
+		if (TextureImporter::cacheDir().empty())
+			return;
+		std::vector<TextureImporter::Levels> data(6);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, this->prefiltered);
+		for (int face = 0; face < 6; face++)
+			for (int level = 0; level < levelCount; level++)
+			{
+				int width = size >> level;
+				data[face].push_back(std::vector<unsigned char>((size_t)width * width * 4));
+				glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_BGRA, GL_UNSIGNED_BYTE, &data[face].back()[0]);
+			}
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+		TextureImporter::writeDDS(cache, TextureImporter::FORMAT_RGBA8, size, size, data);
+	}
+
+	//
+	// the BRDF table
+	//
+	static float radicalInverse(unsigned int bits)
+	{
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return bits * 2.3283064365386963e-10f;
+	}
+
+	// one entry: average the GGX lobe's visibility, split into the part
+	// that scales F0 and the part added to it
+	static void integrate(float n_dot_v, float roughness, float& scale, float& bias)
+	{
+		const unsigned int samples = 512;
+		const float pi = 3.14159265358979f;
+		float a = roughness * roughness;
+		float k = a / 2.0f;	// Smith k for image based lighting
+
+		float v[3] = { sqrtf(1.0f - n_dot_v * n_dot_v), 0.0f, n_dot_v };
+		scale = bias = 0.0f;
+		for (unsigned int i = 0; i < samples; i++)
+		{
+			float phi = 2.0f * pi * i / samples;
+			float xi = radicalInverse(i);
+			float cos_theta = sqrtf((1.0f - xi) / (1.0f + (a * a - 1.0f) * xi));
+			float sin_theta = sqrtf(1.0f - cos_theta * cos_theta);
+			float h[3] = { cosf(phi) * sin_theta, sinf(phi) * sin_theta, cos_theta };
+
+			float v_dot_h = v[0] * h[0] + v[1] * h[1] + v[2] * h[2];
+			float n_dot_l = 2.0f * v_dot_h * h[2] - v[2];
+			if (n_dot_l <= 0.0f)
+				continue;
+			v_dot_h = std::max(v_dot_h, 0.0f);
+			float n_dot_h = std::max(h[2], 0.0f);
+
+			float g = (n_dot_v / (n_dot_v * (1.0f - k) + k)) * (n_dot_l / (n_dot_l * (1.0f - k) + k));
+			float g_vis = g * v_dot_h / (n_dot_h * n_dot_v);
+			float fc = powf(1.0f - v_dot_h, 5.0f);
+			scale += (1.0f - fc) * g_vis;
+			bias += fc * g_vis;
+		}
+		scale /= samples;
+		bias /= samples;
+	}
+
+	// a row of the table per job
+	static void integrateBRDF(std::vector<float>& lut)
+	{
+		lut.resize(lutSize * lutSize * 2);
+		std::vector<std::future<void> > jobs;
+		for (int y = 0; y < lutSize; y++)
+		{
+			float* row = &lut[y * lutSize * 2];
+			jobs.push_back(ThreadPool::shared().submit([row, y]() {
+				float roughness = (y + 0.5f) / lutSize;
+				for (int x = 0; x < lutSize; x++)
+					integrate((x + 0.5f) / lutSize, roughness, row[2 * x], row[2 * x + 1]);
+			}));
+		}
+		for (size_t i = 0; i < jobs.size(); i++)
+			jobs[i].wait();
+	}
+
+	static bool readLUT(const std::string& path, std::vector<float>& lut)
+	{
+		FILE* file = fopen(path.c_str(), "rb");
+		if (!file)
+			return false;
+		char magic[4];
+		int width = 0;
+		lut.resize(lutSize * lutSize * 2);
+		bool ok = fread(magic, 4, 1, file) == 1 && !memcmp(magic, "BRDF", 4) &&
+			fread(&width, sizeof(width), 1, file) == 1 && width == lutSize &&
+			fread(&lut[0], sizeof(float), lut.size(), file) == lut.size();
+		fclose(file);
+		return ok;
+	}
+
+	static void writeLUT(const std::string& path, const std::vector<float>& lut)
+	{
+		if (TextureImporter::cacheDir().empty())
+			return;
+		FILE* file = fopen(path.c_str(), "wb");
+		if (!file)
+			return;
+		int width = lutSize;
+		fwrite("BRDF", 4, 1, file);
+		fwrite(&width, sizeof(width), 1, file);
+		fwrite(&lut[0], sizeof(float), lut.size(), file);
+		fclose(file);
+	}
+};
@@ -0,0 +1,115 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "StateCache.h"
+#include "GpuResources.h"
+
+// A small cubemap the scene is rendered into from one point, so the
+// reflections can see more than the skybox.
+// the faces are refreshed a few at a time, in turn, so the cost per frame
+// stays fixed: the caller asks for nextFace() as many times as its budget
+// allows, draws between begin and end, and calls finish once for the frame
+class EnvironmentProbe
+{
+public:
+	static const int size = 128;
+
+	GLuint cubemap = 0;
+	glm::vec3 position;
+
+	void init()
+	{
+		glGenTextures(1, &this->cubemap);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, this->cubemap);
+		glTexStorage2D(GL_TEXTURE_CUBE_MAP, levels(), GL_RGBA8, size, size);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+		glGenRenderbuffers(1, &this->depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, this->depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, size, size);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &this->fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, this->depth);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		GpuResources& resources = GpuResources::instance();
+		resources.texture(this->cubemap, "probe", "cubemap", GL_RGBA8, size, size, 6, levels());
+		resources.renderbuffer(this->depth, "probe", "depth", GL_DEPTH24_STENCIL8, size, size);
+		resources.framebuffer(this->fbo, "probe", "faces");
+	}
+
+	int levels() const
+	{
+		int levels = 1;
+		for (int width = size; width > 1; width >>= 1)
+			levels++;
+		return levels;
+	}
+
+	// round and round the faces
+	int nextFace()
+	{
+		int face = this->next;
+		this->next = (this->next + 1) % 6;
+		if (face == 5)
+			this->drawn_all = true;
+		return face;
+	}
+
+	// until every face has been drawn once, the budget shouldn't apply
+	bool primed() const
+	{
+		return this->drawn_all;
+	}
+
+	// looking out of a face (the usual cubemap layout: y is down on the sides)
+	glm::mat4 view(int face) const
+	{
+		static const glm::vec3 look[6] = {
+			glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0),
+			glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1) };
+		static const glm::vec3 up[6] = {
+			glm::vec3(0, -1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1),
+			glm::vec3(0, 0, -1), glm::vec3(0, -1, 0), glm::vec3(0, -1, 0) };
+		return glm::lookAt(this->position, this->position + look[face], up[face]);
+	}
+
+	glm::mat4 projection() const
+	{
+		return glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 2000.0f);
+	}
+
+	// draw into a face (the viewport is left for the caller to put back)
+	void begin(int face)
+	{
+		StateCache& state = StateCache::instance();
+		state.bindFramebuffer(this->fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, this->cubemap, 0);
+		state.viewport(0, 0, size, size);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	}
+
+	// the faces for this frame are done - blur them down the levels
+	void finish()
+	{
+		StateCache& state = StateCache::instance();
+		state.bindFramebuffer(0);
+		state.bindTexture(0, GL_TEXTURE_CUBE_MAP, this->cubemap);
+		glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+	}
+
+private:
+	GLuint fbo = 0;
+	GLuint depth = 0;
+	int next = 0;
+	bool drawn_all = false;
+};
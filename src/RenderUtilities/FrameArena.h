@@ -0,0 +1,91 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+// Memory for things that only live for one frame: allocation moves a
+// pointer along a block, and reset gives it all back at once (nothing is
+// destroyed - only put trivially destructible things in here).
+// when a frame needs more than the block holds, another block is added
+// for the rest of the frame, and reset puts everything back into one
+// block big enough for all of it, so a steady frame never allocates
+class FrameArena
+{
+public:
+	explicit FrameArena(size_t initial = 64 * 1024)
+	{
+		this->blocks.reserve(8);
+		this->blocks.push_back(Block(initial));
+	}
+	~FrameArena()
+	{
+		for (size_t i = 0; i < this->blocks.size(); i++)
+			delete[] this->blocks[i].memory;
+	}
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	void* allocate(size_t bytes, size_t align = alignof(std::max_align_t))
+	{
+		Block* block = &this->blocks.back();
+		size_t offset = (block->used + align - 1) & ~(align - 1);
+		if (offset + bytes > block->size)
+		{
+			this->blocks.push_back(Block(std::max(bytes + align, block->size * 2)));
+			block = &this->blocks.back();
+			offset = 0;
+		}
+		block->used = offset + bytes;
+		this->total += bytes;
+		return block->memory + offset;
+	}
+
+	template <class T>
+	T* allocate(size_t count = 1)
+	{
+		return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+	}
+
+	// everything allocated since the last reset is gone
+	void reset()
+	{
+		if (this->blocks.size() > 1)
+		{
+			size_t size = 0;
+			for (size_t i = 0; i < this->blocks.size(); i++)
+			{
+				size += this->blocks[i].size;
+				delete[] this->blocks[i].memory;
+			}
+			this->blocks.clear();
+			this->blocks.push_back(Block(size));
+		}
+		this->blocks.back().used = 0;
+		this->peak = std::max(this->peak, this->total);
+		this->total = 0;
+	}
+
+	// bytes handed out this frame, and the most in any frame so far
+	size_t used() const
+	{
+		return this->total;
+	}
+	size_t peakUsed() const
+	{
+		return std::max(this->peak, this->total);
+	}
+
+private:
+	struct Block
+	{
+		explicit Block(size_t size) : memory(new unsigned char[size]), size(size), used(0) {}
+		unsigned char* memory;
+		size_t size;
+		size_t used;
+	};
+
+	std::vector<Block> blocks;
+	size_t total = 0;
+	size_t peak = 0;
+};
@@ -0,0 +1,347 @@
+#pragma once
+#include <glad/glad.h>
+#include <opencv2\opencv.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include "GpuResources.h"
+#include "SpscQueue.h"
+
+// Records the frames as they are shown, to a PNG sequence or a Y4M video,
+// without stalling the drawing:
+//  - capture reads the frame into one of a ring of pixel pack buffers.
+//    glReadPixels into a buffer returns straight away; the copy happens
+//    on the GPU, and a fence says when it is done
+//  - a later frame (two or three on) finds the fence passed and maps the
+//    buffer. the mapping goes to the writer thread as it is - no copy on
+//    this thread - which flips, converts and writes it
+//  - once written, the buffer is unmapped (on the GL thread, at the next
+//    capture) and goes back in the ring
+// if the writer falls behind and no buffer is free, the frame is skipped
+// (and counted), never waited for.
+// the frames are drawn at whatever rate the drawing manages, the video
+// plays at fps: each frame read stands for the video frames whose time
+// came since the last one - none (it isn't read) when drawing faster,
+// several (written again) when slower or after a skipped one.
+// everything but the writing is called on the thread with the context
+class FrameCapture
+{
+public:
+	enum Format
+	{
+		FORMAT_PNG,		// <name>_00000.png, <name>_00001.png, ...
+		FORMAT_Y4M,		// <name>.y4m, 4:2:0
+	};
+
+	~FrameCapture()
+	{
+		stop();
+	}
+
+	// start a recording called name, to play at fps. a Y4M can't change
+	// size, so it is the size of the first frame (rounded down to even)
+	bool start(const std::string& name, Format format, int fps)
+	{
+		if (this->running)
+			stop();
+		this->name = name;
+		this->format = format;
+		this->fps = fps;
+		this->video = nullptr;
+		this->video_width = this->video_height = 0;
+		this->frames_read = this->frames_written = this->frames_dropped = 0;
+		this->next_mapped = 0;
+		this->frames_timed = 0;
+		this->started = std::chrono::steady_clock::now();
+		this->failed = false;
+
+		if (format == FORMAT_Y4M) {
+			std::string path = name + ".y4m";
+			this->video = fopen(path.c_str(), "wb");
+			if (!this->video) {
+				printf("FrameCapture: can't write %s\n", path.c_str());
+				return false;
+			}
+		}
+
+		if (!this->slots[0].pbo)
+			for (int i = 0; i < slotCount; i++)
+				glGenBuffers(1, &this->slots[i].pbo);
+
+		this->running = true;
+		this->stopping = false;
+		this->writer = std::thread(&FrameCapture::write, this);
+		printf("FrameCapture: recording %s\n", name.c_str());
+		return true;
+	}
+
+	// finish what is in flight and close the recording
+	void stop()
+	{
+		if (!this->running)
+			return;
+
+		// everything read so far still gets written
+		for (int i = 0; i < slotCount; i++)
+			collect(true);
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->stopping = true;
+		}
+		this->wake.notify_one();
+		this->writer.join();
+		collect(false);
+		this->running = false;
+
+		if (this->video)
+			fclose(this->video);
+		this->video = nullptr;
+		for (int i = 0; i < slotCount; i++) {
+			Slot& slot = this->slots[i];
+			glDeleteBuffers(1, &slot.pbo);
+			GpuResources::instance().forget(GpuResources::KIND_BUFFER, slot.pbo);
+			slot.pbo = 0;
+			slot.bytes = 0;
+			slot.state = SLOT_FREE;
+		}
+		printf("FrameCapture: %s done - %u frames written, %u skipped\n",
+			this->name.c_str(), this->frames_written.load(), this->frames_dropped);
+	}
+
+	bool recording() const
+	{
+		return this->running;
+	}
+
+	// read width x height of the framebuffer bound for reading - the
+	// finished frame, before it is swapped
+	void capture(int width, int height)
+	{
+		if (!this->running)
+			return;
+		collect(false);
+
+		// the video frames there should be by now (the first is due at once)
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - this->started).count();
+		unsigned int due = (unsigned int)(elapsed * this->fps) + 1;
+		if (due <= this->frames_timed)
+			return;
+
+		Slot* free_slot = nullptr;
+		for (int i = 0; i < slotCount && !free_slot; i++)
+			if (this->slots[i].state == SLOT_FREE)
+				free_slot = &this->slots[i];
+		if (!free_slot || this->failed) {
+			this->frames_dropped++;
+			return;
+		}
+
+		Slot& slot = *free_slot;
+		GLsizeiptr bytes = (GLsizeiptr) width * height * 4;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		// only (re)made when the size changes
+		if (bytes != slot.bytes) {
+			glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+			slot.bytes = bytes;
+			GpuResources::instance().buffer(slot.pbo, "capture", "frame readback", (size_t)bytes);
+		}
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		// BGRA is what the drivers read fastest, and what OpenCV wants
+		glReadPixels(0, 0, width, height, GL_BGRA, GL_UNSIGNED_BYTE, nullptr);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		slot.width = width;
+		slot.height = height;
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		slot.sequence = this->frames_read++;
+		slot.repeat = due - this->frames_timed;
+		this->frames_timed = due;
+		slot.state = SLOT_READING;
+	}
+
+	unsigned int written() const
+	{
+		return this->frames_written;
+	}
+
+	unsigned int dropped() const
+	{
+		return this->frames_dropped;
+	}
+
+private:
+	static const int slotCount = 4;
+
+	enum SlotState
+	{
+		SLOT_FREE,
+		SLOT_READING,		// glReadPixels issued, fence pending
+		SLOT_WRITING,		// mapped, with the writer
+		SLOT_WRITTEN,		// the writer is done, still mapped
+	};
+
+	struct Slot
+	{
+		GLuint pbo = 0;
+		GLsizeiptr bytes = 0;
+		int width = 0, height = 0;
+		GLsync fence = 0;
+		unsigned int sequence = 0;
+		unsigned int repeat = 1;	// video frames it stands for
+		void* pixels = nullptr;
+		// handed between this thread and the writer
+		std::atomic<int> state{ SLOT_FREE };
+	};
+
+	// unmap what the writer is done with, and hand it the reads that have
+	// arrived, in order (wait: block for the oldest one)
+	void collect(bool wait)
+	{
+		for (int i = 0; i < slotCount; i++) {
+			Slot& slot = this->slots[i];
+			if (slot.state == SLOT_WRITTEN) {
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+				slot.pixels = nullptr;
+				slot.state = SLOT_FREE;
+			}
+		}
+
+		while (Slot* slot = oldestReading()) {
+			GLenum result = glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000 : 0);
+			if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+				return;
+			glDeleteSync(slot->fence);
+			slot->fence = 0;
+
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+			slot->pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot->bytes, GL_MAP_READ_BIT);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			this->next_mapped++;
+			if (!slot->pixels) {
+				slot->state = SLOT_FREE;
+				continue;
+			}
+			slot->state = SLOT_WRITING;
+			{
+				// never full: there are only slotCount slots to hand over.
+				// pushed under the lock, so the writer can't miss the wake
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->queue.push(std::move(slot));
+			}
+			this->wake.notify_one();
+			if (wait)
+				return;
+		}
+	}
+
+	Slot* oldestReading()
+	{
+		for (int i = 0; i < slotCount; i++)
+			if (this->slots[i].state == SLOT_READING && this->slots[i].sequence == this->next_mapped)
+				return &this->slots[i];
+		return nullptr;
+	}
+
+	// the writer thread
+	void write()
+	{
+		while (true) {
+			Slot* slot;
+			{
+				std::unique_lock<std::mutex> lock(this->mutex);
+				this->wake.wait(lock, [this]() { return this->stopping || !this->queue.empty(); });
+				if (!this->queue.pop(slot))
+					return;
+			}
+			if (!this->failed)
+				writeFrame(*slot);
+			slot->state = SLOT_WRITTEN;
+		}
+	}
+
+	void writeFrame(const Slot& slot)
+	{
+		// GL's rows are bottom up
+		cv::Mat read(slot.height, slot.width, CV_8UC4, slot.pixels);
+		cv::Mat image;
+		cv::flip(read, image, 0);
+
+		if (this->format == FORMAT_PNG) {
+			// fast over small - the writer has to keep up
+			std::vector<int> parameters = { cv::IMWRITE_PNG_COMPRESSION, 1 };
+			for (unsigned int i = 0; i < slot.repeat; i++) {
+				char number[16];
+				sprintf(number, "_%05u.png", this->frames_written.load());
+				if (!cv::imwrite(this->name + number, image, parameters)) {
+					printf("FrameCapture: can't write %s%s\n", this->name.c_str(), number);
+					this->failed = true;
+					return;
+				}
+				this->frames_written++;
+			}
+		}
+		else {
+			if (!this->video_width) {
+				this->video_width = slot.width & ~1;
+				this->video_height = slot.height & ~1;
+				fprintf(this->video, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",
+					this->video_width, this->video_height, this->fps);
+			}
+			if (slot.width < this->video_width || slot.height < this->video_height) {
+				printf("FrameCapture: the window shrank, %s stops here\n", this->name.c_str());
+				this->failed = true;
+				return;
+			}
+			// 4:2:0 needs even sizes - and the video's size throughout
+			bool fits = slot.width == this->video_width && slot.height == this->video_height;
+			cv::Mat source = fits ? image : cropped(image);
+			cv::Mat yuv;
+			cv::cvtColor(source, yuv, cv::COLOR_BGRA2YUV_I420);
+			for (unsigned int i = 0; i < slot.repeat; i++) {
+				fputs("FRAME\n", this->video);
+				fwrite(yuv.data, 1, yuv.total() * yuv.elemSize(), this->video);
+			}
+			this->frames_written += slot.repeat;
+		}
+	}
+
+	cv::Mat cropped(const cv::Mat& image) const
+	{
+		cv::Mat part(this->video_height, this->video_width, CV_8UC4);
+		for (int row = 0; row < this->video_height; row++)
+			memcpy(part.ptr<unsigned char>(row), image.ptr<unsigned char>(row), this->video_width * 4);
+		return part;
+	}
+
+	Slot slots[slotCount];
+	unsigned int frames_read = 0;
+	unsigned int next_mapped = 0;
+	unsigned int frames_dropped = 0;
+	unsigned int frames_timed = 0;		// video frames accounted for
+	std::chrono::steady_clock::time_point started;
+	std::atomic<unsigned int> frames_written{ 0 };
+
+	std::string name;
+	Format format = FORMAT_PNG;
+	int fps = 60;
+	FILE* video = nullptr;
+	int video_width = 0, video_height = 0;
+	std::atomic<bool> failed{ false };
+
+	bool running = false;
+	std::thread writer;
+	// the mapped slots, in order - fixed, so a recorded frame allocates nothing
+	SpscQueue<Slot*, slotCount> queue;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+};
@@ -0,0 +1,299 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <algorithm>
+
+// Every texture, buffer, renderbuffer and framebuffer the renderer keeps,
+// with its format, size and owner, so "how much video memory does the
+// scene take" has an answer. whatever makes an object records it here,
+// and forgets it when it is deleted (recording the same object again
+// replaces it - a resize).
+// the bytes are estimates: the texels or blocks and the buffer sizes
+// asked for, not what the driver pads or aligns them to. a framebuffer
+// takes none itself - its attachments are counted.
+// recorded on whichever thread has the context, read from the UI's
+class GpuResources
+{
+public:
+	enum Kind {
+		KIND_TEXTURE = 0,
+		KIND_BUFFER,
+		KIND_RENDERBUFFER,
+		KIND_FRAMEBUFFER,
+	};
+
+	struct Resource
+	{
+		Kind kind;
+		GLuint id;
+		std::string owner;
+		std::string name;
+		GLenum format;		// internal format (0 for buffers and framebuffers)
+		int width;
+		int height;
+		int layers;			// 6 for a cubemap
+		int levels;
+		size_t bytes;
+	};
+
+	static GpuResources& instance()
+	{
+		static GpuResources resources;
+		return resources;
+	}
+
+	void texture(GLuint id, const char* owner, const std::string& name, GLenum format,
+		int width, int height, int layers = 1, int levels = 1)
+	{
+		record(KIND_TEXTURE, id, owner, name, format, width, height, layers, levels,
+			textureBytes(format, width, height, layers, levels));
+	}
+
+	void buffer(GLuint id, const char* owner, const std::string& name, size_t bytes)
+	{
+		record(KIND_BUFFER, id, owner, name, 0, 0, 0, 0, 0, bytes);
+	}
+
+	void renderbuffer(GLuint id, const char* owner, const std::string& name, GLenum format, int width, int height)
+	{
+		record(KIND_RENDERBUFFER, id, owner, name, format, width, height, 1, 1,
+			textureBytes(format, width, height, 1, 1));
+	}
+
+	void framebuffer(GLuint id, const char* owner, const std::string& name)
+	{
+		record(KIND_FRAMEBUFFER, id, owner, name, 0, 0, 0, 0, 0, 0);
+	}
+
+	// it was deleted
+	void forget(Kind kind, GLuint id)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		std::map<Key, Resource>::iterator found = this->resources.find(Key(kind, id));
+		if (found == this->resources.end())
+			return;
+		this->total -= found->second.bytes;
+		this->resources.erase(found);
+		this->changes++;
+	}
+
+	size_t totalBytes() const
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return this->total;
+	}
+
+	// bumped by every record and forget - something showing the totals
+	// only has to look again when it changes
+	unsigned long revision() const
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return this->changes;
+	}
+
+	// what the renderer should fit in (0 is no limit). the registry only
+	// reports against it - the owners of optional resources give them up
+	void setBudget(size_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		if (bytes != this->budget)
+			this->changes++;
+		this->budget = bytes;
+	}
+	size_t overBudget() const
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return (this->budget && this->total > this->budget) ? this->total - this->budget : 0;
+	}
+
+	// one line for a panel: the total, the budget, how many objects
+	void summary(char* text, size_t size) const
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		if (this->budget)
+			snprintf(text, size, "GPU %.1f / %.0f MB, %u", megabytes(this->total), megabytes(this->budget),
+				(unsigned int)this->resources.size());
+		else
+			snprintf(text, size, "GPU %.1f MB, %u", megabytes(this->total), (unsigned int)this->resources.size());
+	}
+
+	// the totals per owner
+	void print() const
+	{
+		std::map<std::string, std::vector<const Resource*> > owners;
+		std::lock_guard<std::mutex> lock(this->mutex);
+		group(owners);
+		printf("GPU resources: %.1f MB in %u objects\n", megabytes(this->total), (unsigned int)this->resources.size());
+		for (std::map<std::string, std::vector<const Resource*> >::const_iterator owner = owners.begin(); owner != owners.end(); ++owner)
+			printf("  %-16s %8.2f MB  %u\n", owner->first.c_str(), megabytes(sum(owner->second)), (unsigned int)owner->second.size());
+	}
+
+	// everything, grouped by owner, as JSON
+	bool writeJson(const char* path) const
+	{
+		FILE* file = fopen(path, "w");
+		if (!file)
+			return false;
+
+		std::map<std::string, std::vector<const Resource*> > owners;
+		std::lock_guard<std::mutex> lock(this->mutex);
+		group(owners);
+		fprintf(file, "{\n  \"total_bytes\": %llu,\n  \"budget_bytes\": %llu,\n  \"owners\": [",
+			(unsigned long long)this->total, (unsigned long long)this->budget);
+		const char* separator = "\n";
+		for (std::map<std::string, std::vector<const Resource*> >::const_iterator owner = owners.begin(); owner != owners.end(); ++owner)
+		{
+			fprintf(file, "%s    {\n      \"owner\": \"%s\",\n      \"bytes\": %llu,\n      \"resources\": [",
+				separator, escape(owner->first).c_str(), (unsigned long long)sum(owner->second));
+			for (size_t i = 0; i < owner->second.size(); i++)
+			{
+				const Resource& r = *owner->second[i];
+				fprintf(file, "%s\n        { \"kind\": \"%s\", \"id\": %u, \"name\": \"%s\", \"format\": \"0x%04X\", "
+					"\"width\": %d, \"height\": %d, \"layers\": %d, \"levels\": %d, \"bytes\": %llu }",
+					i ? "," : "", kindName(r.kind), r.id, escape(r.name).c_str(), r.format,
+					r.width, r.height, r.layers, r.levels, (unsigned long long)r.bytes);
+			}
+			fprintf(file, "\n      ]\n    }");
+			separator = ",\n";
+		}
+		fprintf(file, "\n  ]\n}\n");
+		return fclose(file) == 0;
+	}
+
+	// the texels of every level of every layer (each level half the last)
+	static size_t textureBytes(GLenum format, int width, int height, int layers, int levels)
+	{
+		size_t bytes = 0;
+		for (int i = 0; i < levels; i++)
+		{
+			int block = blockBytes(format);
+			if (block)
+				bytes += (size_t)((width + 3) / 4) * ((height + 3) / 4) * block;
+			else
+				bytes += (size_t)width * height * texelBytes(format);
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+		return bytes * layers;
+	}
+
+	static const char* kindName(Kind kind)
+	{
+		switch (kind)
+		{
+		case KIND_TEXTURE: return "texture";
+		case KIND_BUFFER: return "buffer";
+		case KIND_RENDERBUFFER: return "renderbuffer";
+		default: return "framebuffer";
+		}
+	}
+
+private:
+	typedef std::pair<int, GLuint> Key;
+
+	GpuResources() {}
+
+	void record(Kind kind, GLuint id, const char* owner, const std::string& name, GLenum format,
+		int width, int height, int layers, int levels, size_t bytes)
+	{
+		if (!id)
+			return;
+		std::lock_guard<std::mutex> lock(this->mutex);
+		std::map<Key, Resource>::iterator found = this->resources.find(Key(kind, id));
+		if (found != this->resources.end())
+			this->total -= found->second.bytes;
+		Resource& r = this->resources[Key(kind, id)];
+		this->total += bytes;
+		r.kind = kind;
+		r.id = id;
+		r.owner = owner;
+		r.name = name;
+		r.format = format;
+		r.width = width;
+		r.height = height;
+		r.layers = layers;
+		r.levels = levels;
+		r.bytes = bytes;
+		this->changes++;
+	}
+
+	// (with the lock held)
+	void group(std::map<std::string, std::vector<const Resource*> >& owners) const
+	{
+		for (std::map<Key, Resource>::const_iterator r = this->resources.begin(); r != this->resources.end(); ++r)
+			owners[r->second.owner].push_back(&r->second);
+	}
+
+	static size_t sum(const std::vector<const Resource*>& resources)
+	{
+		size_t bytes = 0;
+		for (size_t i = 0; i < resources.size(); i++)
+			bytes += resources[i]->bytes;
+		return bytes;
+	}
+
+	static double megabytes(size_t bytes)
+	{
+		return bytes / (1024.0 * 1024.0);
+	}
+
+	// a name is mostly a path - backslashes and quotes need escaping
+	static std::string escape(const std::string& text)
+	{
+		std::string escaped;
+		for (size_t i = 0; i < text.size(); i++)
+		{
+			if (text[i] == '"' || text[i] == '\\')
+				escaped += '\\';
+			if ((unsigned char)text[i] >= ' ')
+				escaped += text[i];
+		}
+		return escaped;
+	}
+
+	// bytes per 4x4 block of the compressed formats (0 for the others)
+	static int blockBytes(GLenum format)
+	{
+		switch (format)
+		{
+		case 0x83F0:	// S3TC DXT1 rgb
+		case 0x83F1:	// S3TC DXT1 rgba
+		case GL_COMPRESSED_RED_RGTC1:
+		case GL_COMPRESSED_SIGNED_RED_RGTC1:
+			return 8;
+		case 0x83F2:	// S3TC DXT3
+		case 0x83F3:	// S3TC DXT5
+		case GL_COMPRESSED_RG_RGTC2:
+		case GL_COMPRESSED_SIGNED_RG_RGTC2:
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	// uncompressed texels as drivers keep them (3 channels padded to 4)
+	static int texelBytes(GLenum format)
+	{
+		switch (format)
+		{
+		case GL_R8: return 1;
+		case GL_RG8: case GL_R16F: case GL_DEPTH_COMPONENT16: return 2;
+		case GL_RGBA16F: case GL_RGB16F: case GL_RG32F: return 8;
+		case GL_RGBA32F: case GL_RGB32F: return 16;
+		default: return 4;	// RGB8, RGBA8, RG16F, R32F, depth 24 / stencil 8
+		}
+	}
+
+private:
+	mutable std::mutex mutex;
+	std::map<Key, Resource> resources;
+	size_t total = 0;
+	size_t budget = 0;
+	unsigned long changes = 0;
+};
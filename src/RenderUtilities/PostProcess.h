@@ -0,0 +1,193 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+
+#include "Shader.h"
+#include "StateCache.h"
+#include "RenderTargetPool.h"
+
+// The passes between the rendered scene and the window, each its own
+// small program:
+//	bloom (bright pass at half size, down to a quarter, blurred both ways)
+//	-> resolve (the scene up to window size, sharpened, plus the bloom)
+//	-> tone mapping -> pixelate -> FXAA
+// only the resolve always runs; an effect that is off isn't drawn at all.
+// the last pass that runs draws into the window, the others into targets
+// from the pool, so once the first frame has made them nothing is
+// allocated
+class PostProcess
+{
+public:
+	struct Settings
+	{
+		bool bloom = false;
+		bool tonemap = false;
+		bool pixelate = false;
+		bool fxaa = false;
+		float bloom_threshold = 1.0f;
+		float bloom_strength = 0.6f;
+		float exposure = 1.0f;
+	};
+
+	// where the scene is: the corner (width x height) of a texture of
+	// texture_width x texture_height
+	struct Scene
+	{
+		GLuint texture;
+		int texture_width, texture_height;
+		int width, height;
+		float sharpness;
+	};
+
+	// draw the scene into the window (framebuffer 0) of width x height.
+	// quad is the vertex array of two triangles covering the screen, with
+	// texture coordinates
+	void run(const Scene& scene, const Settings& settings, int width, int height, GLuint quad)
+	{
+		if (!this->resolve)
+			init();
+		StateCache& state = StateCache::instance();
+		state.setEnabled(GL_DEPTH_TEST, false);
+		state.setEnabled(GL_CULL_FACE, false);
+		state.setEnabled(GL_BLEND, false);
+		state.bindVertexArray(quad);
+
+		glm::vec2 texel(1.0f / scene.texture_width, 1.0f / scene.texture_height);
+		glm::vec2 filled(scene.width * texel.x, scene.height * texel.y);
+		glm::vec2 last(filled.x - 0.5f * texel.x, filled.y - 0.5f * texel.y);
+
+		RenderTargetPool::Target* bloom = nullptr;
+		if (settings.bloom)
+		{
+			int half_w = std::max(1, width / 2), half_h = std::max(1, height / 2);
+			int quarter_w = std::max(1, width / 4), quarter_h = std::max(1, height / 4);
+
+			RenderTargetPool::Target* half = this->targets.acquire(half_w, half_h, GL_RGBA16F);
+			begin(this->bright, half, width, height);
+			glUniform2f(glGetUniformLocation(this->bright->Program, "u_uv_scale"), filled.x, filled.y);
+			glUniform2f(glGetUniformLocation(this->bright->Program, "u_uv_max"), last.x, last.y);
+			glUniform2f(glGetUniformLocation(this->bright->Program, "u_texel"), texel.x, texel.y);
+			glUniform1f(glGetUniformLocation(this->bright->Program, "u_threshold"), settings.bloom_threshold);
+			draw(scene.texture);
+
+			bloom = this->targets.acquire(quarter_w, quarter_h, GL_RGBA16F);
+			begin(this->downsample, bloom, width, height);
+			glUniform2f(glGetUniformLocation(this->downsample->Program, "u_texel"), 1.0f / half_w, 1.0f / half_h);
+			draw(half->texture);
+			this->targets.release(half);
+
+			RenderTargetPool::Target* across = this->targets.acquire(quarter_w, quarter_h, GL_RGBA16F);
+			begin(this->blur, across, width, height);
+			glUniform2f(glGetUniformLocation(this->blur->Program, "u_direction"), 1.0f / quarter_w, 0.0f);
+			draw(bloom->texture);
+			begin(this->blur, bloom, width, height);
+			glUniform2f(glGetUniformLocation(this->blur->Program, "u_direction"), 0.0f, 1.0f / quarter_h);
+			draw(across->texture);
+			this->targets.release(across);
+		}
+
+		// the resolve. it stays in floating point for the tone mapping
+		bool more = settings.tonemap || settings.pixelate || settings.fxaa;
+		RenderTargetPool::Target* current = more ?
+			this->targets.acquire(width, height, settings.tonemap ? GL_RGBA16F : GL_RGBA8) : nullptr;
+		begin(this->resolve, current, width, height);
+		glUniform2f(glGetUniformLocation(this->resolve->Program, "u_uv_scale"), filled.x, filled.y);
+		glUniform2f(glGetUniformLocation(this->resolve->Program, "u_uv_max"), last.x, last.y);
+		glUniform2f(glGetUniformLocation(this->resolve->Program, "u_texel"), texel.x, texel.y);
+		glUniform1f(glGetUniformLocation(this->resolve->Program, "u_sharpness"), scene.sharpness);
+		glUniform1f(glGetUniformLocation(this->resolve->Program, "u_bloom_strength"), bloom ? settings.bloom_strength : 0.0f);
+		state.bindTexture(1, GL_TEXTURE_2D, bloom ? bloom->texture : 0);
+		draw(scene.texture);
+		if (bloom)
+			this->targets.release(bloom);
+
+		if (settings.tonemap)
+		{
+			more = settings.pixelate || settings.fxaa;
+			RenderTargetPool::Target* next = more ? this->targets.acquire(width, height, GL_RGBA8) : nullptr;
+			begin(this->tonemap, next, width, height);
+			glUniform1f(glGetUniformLocation(this->tonemap->Program, "u_exposure"), settings.exposure);
+			current = chain(current, next);
+		}
+		if (settings.pixelate)
+		{
+			RenderTargetPool::Target* next = settings.fxaa ? this->targets.acquire(width, height, GL_RGBA8) : nullptr;
+			begin(this->pixelate, next, width, height);
+			glUniform1f(glGetUniformLocation(this->pixelate->Program, "screen_w"), (float)width);
+			glUniform1f(glGetUniformLocation(this->pixelate->Program, "screen_h"), (float)height);
+			current = chain(current, next);
+		}
+		if (settings.fxaa)
+		{
+			begin(this->fxaa, nullptr, width, height);
+			glUniform2f(glGetUniformLocation(this->fxaa->Program, "u_texel"), 1.0f / width, 1.0f / height);
+			current = chain(current, nullptr);
+		}
+
+		this->targets.endFrame();
+	}
+
+	RenderTargetPool& pool()
+	{
+		return this->targets;
+	}
+
+private:
+	void init()
+	{
+		const char* vert = "src/shaders/framebuffer_screen.vert";
+		this->resolve = new Shader(vert, nullptr, nullptr, nullptr, "src/shaders/framebuffer_screen.frag");
+		this->bright = new Shader(vert, nullptr, nullptr, nullptr, "src/shaders/post_bright.frag");
+		this->downsample = new Shader(vert, nullptr, nullptr, nullptr, "src/shaders/post_downsample.frag");
+		this->blur = new Shader(vert, nullptr, nullptr, nullptr, "src/shaders/post_blur.frag");
+		this->tonemap = new Shader(vert, nullptr, nullptr, nullptr, "src/shaders/post_tonemap.frag");
+		this->pixelate = new Shader(vert, nullptr, nullptr, nullptr, "src/shaders/post_pixelate.frag");
+		this->fxaa = new Shader(vert, nullptr, nullptr, nullptr, "src/shaders/post_fxaa.frag");
+
+		// the source is always on unit 0 (and the resolve's bloom on 1)
+		Shader* all[] = { this->resolve, this->bright, this->downsample, this->blur, this->tonemap, this->pixelate, this->fxaa };
+		for (Shader* shader : all)
+		{
+			shader->Use();
+			shader->setInt("u_source", 0);
+		}
+		this->resolve->setInt("screenTexture", 0);
+		this->resolve->setInt("u_bloom", 1);
+	}
+
+	// draw into target (the window when there is none) with shader
+	void begin(Shader* shader, RenderTargetPool::Target* target, int width, int height)
+	{
+		StateCache& state = StateCache::instance();
+		state.bindFramebuffer(target ? target->fbo : 0);
+		state.viewport(0, 0, target ? target->width : width, target ? target->height : height);
+		shader->Use();
+	}
+
+	void draw(GLuint source)
+	{
+		StateCache::instance().bindTexture(0, GL_TEXTURE_2D, source);
+		glDrawArrays(GL_TRIANGLES, 0, 6);
+	}
+
+	// the pass set up by begin reads from current and writes next, which
+	// is current for the pass after it
+	RenderTargetPool::Target* chain(RenderTargetPool::Target* current, RenderTargetPool::Target* next)
+	{
+		draw(current->texture);
+		this->targets.release(current);
+		return next;
+	}
+
+	RenderTargetPool targets;
+
+	Shader* resolve = nullptr;
+	Shader* bright = nullptr;
+	Shader* downsample = nullptr;
+	Shader* blur = nullptr;
+	Shader* tonemap = nullptr;
+	Shader* pixelate = nullptr;
+	Shader* fxaa = nullptr;
+};
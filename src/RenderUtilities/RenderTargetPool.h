@@ -0,0 +1,137 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <vector>
+#include <cstddef>
+
+#include "StateCache.h"
+#include "GpuResources.h"
+
+// Colour targets (a texture and the framebuffer drawing into it) for the
+// passes that only need one for a moment - post-processing, blurs.
+// acquire hands out a free target of exactly that size and format, making
+// one only if there is none, and release gives it back for the next pass
+// (or the next frame) to use. the same passes every frame reuse the same
+// targets. ones that go unused for a while (the old sizes after the window
+// is resized) are deleted at endFrame
+class RenderTargetPool
+{
+public:
+	struct Target
+	{
+		GLuint fbo;
+		GLuint texture;
+		int width;
+		int height;
+		GLenum format;
+	};
+
+	~RenderTargetPool()
+	{
+		for (size_t i = 0; i < this->slots.size(); i++)
+			delete this->slots[i];
+	}
+
+	Target* acquire(int width, int height, GLenum format)
+	{
+		for (size_t i = 0; i < this->slots.size(); i++)
+		{
+			Slot* slot = this->slots[i];
+			if (!slot->in_use && slot->target.width == width && slot->target.height == height && slot->target.format == format)
+			{
+				slot->in_use = slot->used = true;
+				return &slot->target;
+			}
+		}
+
+		Slot* slot = new Slot;
+		slot->in_use = slot->used = true;
+		slot->idle_frames = 0;
+		Target& target = slot->target;
+		target.width = width;
+		target.height = height;
+		target.format = format;
+
+		glGenTextures(1, &target.texture);
+		glBindTexture(GL_TEXTURE_2D, target.texture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenFramebuffers(1, &target.fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.texture, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		// bound behind the cache's back
+		StateCache::instance().invalidate();
+		GpuResources::instance().texture(target.texture, "render targets", "target", format, width, height);
+		GpuResources::instance().framebuffer(target.fbo, "render targets", "target");
+
+		this->slots.push_back(slot);
+		return &target;
+	}
+
+	void release(Target* target)
+	{
+		for (size_t i = 0; i < this->slots.size(); i++)
+			if (&this->slots[i]->target == target)
+				this->slots[i]->in_use = false;
+	}
+
+	// delete what hasn't been used for maxIdleFrames
+	void endFrame()
+	{
+		for (size_t i = 0; i < this->slots.size(); )
+		{
+			Slot* slot = this->slots[i];
+			slot->idle_frames = slot->used ? 0 : slot->idle_frames + 1;
+			slot->used = false;
+			if (!slot->in_use && slot->idle_frames > maxIdleFrames)
+			{
+				glDeleteFramebuffers(1, &slot->target.fbo);
+				glDeleteTextures(1, &slot->target.texture);
+				GpuResources::instance().forget(GpuResources::KIND_FRAMEBUFFER, slot->target.fbo);
+				GpuResources::instance().forget(GpuResources::KIND_TEXTURE, slot->target.texture);
+				delete slot;
+				this->slots[i] = this->slots.back();
+				this->slots.pop_back();
+				StateCache::instance().invalidate();
+			}
+			else
+				i++;
+		}
+	}
+
+	size_t size() const
+	{
+		return this->slots.size();
+	}
+
+	// video memory the targets take
+	size_t bytes() const
+	{
+		size_t total = 0;
+		for (size_t i = 0; i < this->slots.size(); i++)
+		{
+			const Target& target = this->slots[i]->target;
+			total += (size_t)target.width * target.height * (target.format == GL_RGBA16F ? 8 : 4);
+		}
+		return total;
+	}
+
+private:
+	static const int maxIdleFrames = 60;
+
+	struct Slot
+	{
+		Target target;
+		bool in_use;
+		bool used;			// acquired since the last endFrame
+		int idle_frames;
+	};
+
+	std::vector<Slot*> slots;
+};
@@ -9,6 +9,8 @@
 #include <iostream>
 #include <vector>
 
+#include "StateCache.h"
+
 
 
 class Shader
@@ -78,12 +80,14 @@ public:
 	// Uses the current shader
 	void Use()
 	{
-		glUseProgram(this->Program);
+		StateCache::instance().useProgram(this->Program);
 	}
 
-	void setInt(const std::string& name, int value)
+	// a name, not a std::string - a literal would be copied into one on
+	// every call
+	void setInt(const char* name, int value)
 	{
-		glUniform1i(glGetUniformLocation(this->Program,name.c_str()),value);
+		glUniform1i(glGetUniformLocation(this->Program, name), value);
 	}
 private:
 	std::string readCode(const GLchar* path)
@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// A fixed-size queue between exactly one thread pushing and one thread
+// popping, with no lock: each side only writes its own index, and reads
+// the other's with acquire, so what was pushed is all there when it is
+// popped. push fails when it is full (the producer decides what to do
+// with what didn't fit), pop fails when it is empty
+template <class T, size_t Capacity>
+class SpscQueue
+{
+public:
+	// the producer only
+	bool push(T&& value)
+	{
+		size_t tail = this->tail.load(std::memory_order_relaxed);
+		size_t next = (tail + 1) % slotCount;
+		if (next == this->head.load(std::memory_order_acquire))
+			return false;
+		this->slots[tail] = std::move(value);
+		this->tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// the consumer only
+	bool pop(T& value)
+	{
+		size_t head = this->head.load(std::memory_order_relaxed);
+		if (head == this->tail.load(std::memory_order_acquire))
+			return false;
+		value = std::move(this->slots[head]);
+		this->head.store((head + 1) % slotCount, std::memory_order_release);
+		return true;
+	}
+
+	// either side; only a hint, the other may be changing it
+	bool empty() const
+	{
+		return this->head.load(std::memory_order_acquire) == this->tail.load(std::memory_order_acquire);
+	}
+
+private:
+	// one slot is always left free, to tell full from empty
+	static const size_t slotCount = Capacity + 1;
+
+	T slots[slotCount];
+	// on lines of their own, so the two threads don't fight over one
+	alignas(64) std::atomic<size_t> head{ 0 };
+	alignas(64) std::atomic<size_t> tail{ 0 };
+};
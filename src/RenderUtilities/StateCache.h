@@ -0,0 +1,243 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdio>
+
+// Keeps the OpenGL state it last set (program, vertex array, textures and
+// samplers per unit, framebuffer, depth/cull/blend) and skips any call that
+// would set it to what it already is - each GL call costs CPU time in the
+// driver, and on the software and older integrated drivers that is most of
+// the frame.
+// it only knows about the calls that went through it: after code that
+// sets state with GL directly (the fixed-function helpers, loading) call
+// invalidate, and the next call of each kind goes through again
+class StateCache
+{
+public:
+	static const int maxUnits = 16;
+
+	struct Stats
+	{
+		unsigned int issued = 0;	// passed on to GL
+		unsigned int elided = 0;	// already set, skipped
+	};
+
+	static StateCache& instance()
+	{
+		static StateCache cache;
+		return cache;
+	}
+
+	// forget all of the state - the next of every call is issued
+	void invalidate()
+	{
+		this->program = unknown;
+		this->vertex_array = unknown;
+		this->framebuffer = unknown;
+		this->active_unit = -1;
+		for (int i = 0; i < maxUnits; i++)
+		{
+			this->texture_2d[i] = unknown;
+			this->texture_cube[i] = unknown;
+			this->sampler[i] = unknown;
+		}
+		for (int i = 0; i < capCount; i++)
+			this->caps[i] = -1;
+		this->depth_func = this->cull_face = this->front_face = unknown;
+		this->blend_src = this->blend_dst = unknown;
+		this->depth_mask = -1;
+		this->color_mask = -1;
+		this->viewport_rect[0] = this->viewport_rect[1] = this->viewport_rect[2] = this->viewport_rect[3] = -1;
+	}
+
+	void useProgram(GLuint id)
+	{
+		if (changed(this->program, id))
+			glUseProgram(id);
+	}
+
+	void bindVertexArray(GLuint id)
+	{
+		if (changed(this->vertex_array, id))
+			glBindVertexArray(id);
+	}
+
+	// GL_FRAMEBUFFER (read and draw together)
+	void bindFramebuffer(GLuint id)
+	{
+		if (changed(this->framebuffer, id))
+			glBindFramebuffer(GL_FRAMEBUFFER, id);
+	}
+
+	// GL_TEXTURE_2D and GL_TEXTURE_CUBE_MAP are tracked, other targets
+	// always go through
+	void bindTexture(int unit, GLenum target, GLuint id)
+	{
+		GLuint* bound = (target == GL_TEXTURE_2D) ? &this->texture_2d[unit] :
+			(target == GL_TEXTURE_CUBE_MAP) ? &this->texture_cube[unit] : nullptr;
+		if (bound && !changed(*bound, id))
+			return;
+		if (!bound)
+			this->counts.issued++;
+		activeTexture(unit);
+		glBindTexture(target, id);
+	}
+
+	void bindSampler(int unit, GLuint id)
+	{
+		if (changed(this->sampler[unit], id))
+			glBindSampler(unit, id);
+	}
+
+	// GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND and GL_STENCIL_TEST
+	void setEnabled(GLenum cap, bool on)
+	{
+		int index = capIndex(cap);
+		if (index < 0 || this->caps[index] != (int)on)
+		{
+			if (index >= 0)
+				this->caps[index] = on;
+			this->counts.issued++;
+			if (on)
+				glEnable(cap);
+			else
+				glDisable(cap);
+		}
+		else
+			this->counts.elided++;
+	}
+
+	void depthFunc(GLenum func)
+	{
+		if (changed(this->depth_func, func))
+			glDepthFunc(func);
+	}
+
+	void depthMask(bool on)
+	{
+		if (changed(this->depth_mask, (int)on))
+			glDepthMask(on ? GL_TRUE : GL_FALSE);
+	}
+
+	void colorMask(bool on)
+	{
+		if (changed(this->color_mask, (int)on))
+			glColorMask(on, on, on, on);
+	}
+
+	void cullFace(GLenum mode)
+	{
+		if (changed(this->cull_face, mode))
+			glCullFace(mode);
+	}
+
+	void frontFace(GLenum mode)
+	{
+		if (changed(this->front_face, mode))
+			glFrontFace(mode);
+	}
+
+	void blendFunc(GLenum src, GLenum dst)
+	{
+		if (this->blend_src == src && this->blend_dst == dst)
+		{
+			this->counts.elided++;
+			return;
+		}
+		this->blend_src = src;
+		this->blend_dst = dst;
+		this->counts.issued++;
+		glBlendFunc(src, dst);
+	}
+
+	void viewport(int x, int y, int width, int height)
+	{
+		int* rect = this->viewport_rect;
+		if (rect[0] == x && rect[1] == y && rect[2] == width && rect[3] == height)
+		{
+			this->counts.elided++;
+			return;
+		}
+		rect[0] = x; rect[1] = y; rect[2] = width; rect[3] = height;
+		this->counts.issued++;
+		glViewport(x, y, width, height);
+	}
+
+	// counts since resetStats (once a frame)
+	const Stats& stats() const
+	{
+		return this->counts;
+	}
+
+	void resetStats()
+	{
+		this->counts = Stats();
+	}
+
+	void printStats() const
+	{
+		printf("GL state: %u calls issued, %u elided\n", this->counts.issued, this->counts.elided);
+	}
+
+private:
+	static const GLuint unknown = 0xffffffffu;
+	static const int capCount = 4;
+
+	StateCache()
+	{
+		invalidate();
+	}
+
+	static int capIndex(GLenum cap)
+	{
+		switch (cap)
+		{
+		case GL_DEPTH_TEST: return 0;
+		case GL_CULL_FACE: return 1;
+		case GL_BLEND: return 2;
+		case GL_STENCIL_TEST: return 3;
+		default: return -1;
+		}
+	}
+
+	// record the new value, and count the call as issued or elided
+	template <class T>
+	bool changed(T& current, T value)
+	{
+		if (current == value)
+		{
+			this->counts.elided++;
+			return false;
+		}
+		current = value;
+		this->counts.issued++;
+		return true;
+	}
+
+	void activeTexture(int unit)
+	{
+		if (this->active_unit != unit)
+		{
+			this->active_unit = unit;
+			this->counts.issued++;
+			glActiveTexture(GL_TEXTURE0 + unit);
+		}
+		else
+			this->counts.elided++;
+	}
+
+	GLuint program;
+	GLuint vertex_array;
+	GLuint framebuffer;
+	int active_unit;
+	GLuint texture_2d[maxUnits];
+	GLuint texture_cube[maxUnits];
+	GLuint sampler[maxUnits];
+	int caps[capCount];		// -1 unknown, else 0 or 1
+	GLenum depth_func, cull_face, front_face;
+	GLenum blend_src, blend_dst;
+	int depth_mask;
+	int color_mask;
+	int viewport_rect[4];
+
+	Stats counts;
+};
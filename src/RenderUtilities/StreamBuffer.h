@@ -0,0 +1,194 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+
+#include "GpuResources.h"
+
+// One buffer, mapped once for good (persistent and coherent), for the
+// data that changes every frame - the shared matrices, the instances,
+// the water's lights.
+// writing is a memcpy into the mapping: no glBufferSubData, so nothing
+// for the driver to copy or to wait on.
+// the buffer is split into regionCount regions, one per frame in flight.
+// a frame takes its pieces from its region, in order; at the end of the
+// frame a fence goes after the GL work that reads them, and the region is
+// only written again once that fence has passed (usually long before -
+// it is regionCount frames later)
+// a frame that runs out of room gets empty allocations (the caller skips
+// the draw) and the buffer is made twice the size at the next beginFrame
+class StreamBuffer
+{
+public:
+	static const int regionCount = 3;
+
+	struct Allocation
+	{
+		void* data = nullptr;		// where to write it
+		GLintptr offset = 0;		// where GL reads it, in buffer()
+		GLsizeiptr size = 0;
+
+		bool valid() const
+		{
+			return this->data != nullptr;
+		}
+	};
+
+	~StreamBuffer()
+	{
+		release();
+	}
+
+	void init(GLsizeiptr region_size)
+	{
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &this->uniform_alignment);
+		create(region_size);
+	}
+
+	GLuint buffer() const
+	{
+		return this->id;
+	}
+
+	// frames since init, to tell whether something was uploaded this frame
+	unsigned int frame() const
+	{
+		return this->frame_count;
+	}
+
+	// what a uniform block's offset has to be a multiple of
+	GLsizeiptr uniformAlignment() const
+	{
+		return this->uniform_alignment;
+	}
+
+	// move to the next region, waiting for the GPU to be done with it
+	void beginFrame()
+	{
+		if (this->overflowed) {
+			// every region has to be free before the buffer goes
+			for (int i = 0; i < regionCount; i++)
+				wait(i);
+			GLsizeiptr grown = this->region_size * 2;
+			release();
+			create(grown);
+			this->grow_count++;
+			this->overflowed = false;
+		}
+
+		this->region = (this->region + 1) % regionCount;
+		wait(this->region);
+		this->used = 0;
+		this->frame_count++;
+	}
+
+	// fence the region: it is free again when the GL work so far is done
+	void endFrame()
+	{
+		this->fences[this->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	// bytes from this frame's region, starting at a multiple of align
+	Allocation allocate(GLsizeiptr bytes, GLsizeiptr align = 16)
+	{
+		Allocation allocation;
+		GLsizeiptr start = (this->used + align - 1) / align * align;
+		if (start + bytes > this->region_size) {
+			this->overflowed = true;
+			return allocation;
+		}
+		this->used = start + bytes;
+		allocation.offset = this->region * this->region_size + start;
+		allocation.data = this->mapped + allocation.offset;
+		allocation.size = bytes;
+		return allocation;
+	}
+
+	// copy data in, and hand back where it went
+	Allocation upload(const void* data, GLsizeiptr bytes, GLsizeiptr align = 16)
+	{
+		Allocation allocation = allocate(bytes, align);
+		if (allocation.valid())
+			memcpy(allocation.data, data, bytes);
+		return allocation;
+	}
+
+	// times beginFrame had to wait for the GPU
+	unsigned int stalls() const
+	{
+		return this->stall_count;
+	}
+
+	void printStats() const
+	{
+		printf("StreamBuffer: %ld bytes a frame (grown %u times), %ld used last frame, %u stalls\n",
+			(long) this->region_size, this->grow_count, (long) this->used, this->stall_count);
+	}
+
+private:
+	void create(GLsizeiptr size)
+	{
+		this->region_size = size;
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glGenBuffers(1, &this->id);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, this->id);
+		glBufferStorage(GL_COPY_WRITE_BUFFER, size * regionCount, nullptr, flags);
+		this->mapped = (char*) glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size * regionCount, flags);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		this->region = 0;
+		this->used = 0;
+		GpuResources::instance().buffer(this->id, "stream", "per-frame data", (size_t)size * regionCount);
+	}
+
+	void release()
+	{
+		if (!this->id)
+			return;
+		for (int i = 0; i < regionCount; i++) {
+			if (this->fences[i])
+				glDeleteSync(this->fences[i]);
+			this->fences[i] = 0;
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, this->id);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glDeleteBuffers(1, &this->id);
+		GpuResources::instance().forget(GpuResources::KIND_BUFFER, this->id);
+		this->id = 0;
+		this->mapped = nullptr;
+	}
+
+	void wait(int index)
+	{
+		GLsync fence = this->fences[index];
+		if (!fence)
+			return;
+		GLenum result = glClientWaitSync(fence, 0, 0);
+		if (result == GL_TIMEOUT_EXPIRED) {
+			this->stall_count++;
+			// flush once, so the fence itself gets to the GPU
+			GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+			do {
+				result = glClientWaitSync(fence, flags, 1000000);	// 1 ms
+				flags = 0;
+			} while (result == GL_TIMEOUT_EXPIRED);
+		}
+		glDeleteSync(fence);
+		this->fences[index] = 0;
+	}
+
+	GLuint id = 0;
+	char* mapped = nullptr;
+	GLsizeiptr region_size = 0;
+	GLint uniform_alignment = 256;
+
+	GLsync fences[regionCount] = { 0 };
+	int region = 0;
+	GLsizeiptr used = 0;
+	bool overflowed = false;
+	unsigned int frame_count = 0;
+	unsigned int stall_count = 0;
+	unsigned int grow_count = 0;
+};
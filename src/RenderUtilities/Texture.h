@@ -4,6 +4,8 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "AssetManager.h"
+#include "StateCache.h"
 
 class Texture2D
 {
@@ -17,43 +19,27 @@ public:
 
 	Type type;
 
-	Texture2D(const char* path, Type texture_type = Texture2D::TEXTURE_DEFAULT):
+	Texture2D(const char* path, Type texture_type = Texture2D::TEXTURE_DEFAULT,
+		TextureImporter::Format format = TextureImporter::FORMAT_RGBA8):
 		type(texture_type)
 	{
-		cv::Mat img;
-		//cv::imread(path, cv::IMREAD_COLOR).convertTo(img, CV_32FC3, 1 / 255.0f);	//unsigned char to float
-		img = cv::imread(path, cv::IMREAD_COLOR);
-
-		this->size.x = img.cols;
-		this->size.y = img.rows;
-
-		//cv::cvtColor(img, img, CV_BGR2RGB);
-
-		glGenTextures(1, &this->id);
-
-		glBindTexture(GL_TEXTURE_2D, this->id);
-		glGenerateMipmap(GL_TEXTURE_2D);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		if(img.type() == CV_8UC3)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, img.cols, img.rows, 0, GL_BGR, GL_UNSIGNED_BYTE, img.data);
-		else if (img.type() == CV_8UC4)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, img.cols, img.rows, 0, GL_BGRA, GL_UNSIGNED_BYTE, img.data);
-		glBindTexture(GL_TEXTURE_2D, 0);
-
-		img.release();
+		//mipmapped, and compressed (then cached) if a format is asked for
+		this->id = AssetManager::instance().acquireTexture(path, format, &this->size);
+	}
+	~Texture2D()
+	{
+		AssetManager::instance().release(this->id);
 	}
+	// each one holds a reference - a copy would give it back twice
+	Texture2D(const Texture2D&) = delete;
+	Texture2D& operator=(const Texture2D&) = delete;
 	void bind(GLenum bind_unit)
 	{
-		glActiveTexture(GL_TEXTURE0 + bind_unit);
-		glBindTexture(GL_TEXTURE_2D, this->id);
+		StateCache::instance().bindTexture(bind_unit, GL_TEXTURE_2D, this->id);
 	}
 	static void unbind(GLenum bind_unit)
 	{
-		glActiveTexture(GL_TEXTURE0 + bind_unit);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		StateCache::instance().bindTexture(bind_unit, GL_TEXTURE_2D, 0);
 	}
 	glm::ivec2 size;
 public:
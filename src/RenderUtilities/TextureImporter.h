@@ -0,0 +1,748 @@
+#pragma once
+#include <opencv2\opencv.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "ThreadPool.h"
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include <ctime>
+#include <algorithm>
+#include <map>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+// S3TC is an extension (everywhere that matters), so glad doesn't have it
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+// Loads images into immutable, fully mipmapped 2D textures.
+// The block compressed formats are encoded on the CPU the first time and
+// kept as .dds files in the cache directory, so later runs skip both the
+// decode and the encode. a cache file older than its image is rebuilt.
+class TextureImporter
+{
+public:
+	enum Format {
+		FORMAT_RGBA8 = 0,	// uncompressed (RGB8 or RGBA8, like the image)
+		FORMAT_BC1,			// rgb, 4 bits a pixel
+		FORMAT_BC4,			// red only, 4 bits a pixel (height maps)
+		FORMAT_BC5,			// red and green, 8 bits a pixel (normal maps)
+	};
+	// the encoded mip levels of one image, biggest first
+	typedef std::vector<std::vector<unsigned char> > Levels;
+
+	// where the compressed textures are kept ("" turns the cache off)
+	static std::string& cacheDir()
+	{
+		static std::string dir = "Images/cache";
+		return dir;
+	}
+
+	// load an image file into a new texture
+	static GLuint load(const char* path, Format format, glm::ivec2* size = nullptr)
+	{
+		if (format != FORMAT_RGBA8)
+		{
+			GLuint id = loadCache(path, format, size);
+			if (id)
+				return id;
+		}
+
+		cv::Mat img = cv::imread(path, cv::IMREAD_COLOR);
+		if (img.empty())
+		{
+			std::cout << "ERROR::TEXTURE::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+			return 0;
+		}
+		GLuint id = (format == FORMAT_RGBA8) ? uploadUncompressed(img) : build(img, format, path);
+		if (size)
+			*size = glm::ivec2(img.cols, img.rows);
+		img.release();
+		return id;
+	}
+
+	// upload an image that is already in memory (BGR or BGRA, as opencv
+	// gives it). with a path, the compressed result is cached under it
+	static GLuint upload(const cv::Mat& img, Format format, const char* path = nullptr)
+	{
+		if (format == FORMAT_RGBA8)
+			return uploadUncompressed(img);
+
+		if (path)
+		{
+			GLuint id = loadCache(path, format, nullptr);
+			if (id)
+				return id;
+		}
+		return build(img, format, path);
+	}
+
+	// a cubemap from six images (+x, -x, +y, -y, +z, -z), or from a single 
+	// baked .dds cubemap (then nothing is decoded at all). the faces are
+	// decoded and encoded at the same time on the shared thread pool, and
+	// the result is cached as one .dds cubemap, like the 2D textures
+	static GLuint loadCubemap(const std::vector<const char*>& faces, Format format, int* size = nullptr)
+	{
+		std::vector<Levels> data;
+		int width = 0, height = 0;
+
+		if (faces.size() == 1)
+		{
+			if (!readDDS(faces[0], format, 6, width, height, data))
+			{
+				std::cout << "ERROR::TEXTURE::NOT_A_CUBEMAP " << faces[0] << std::endl;
+				return 0;
+			}
+			return uploadCubemap(format, width, data, size);
+		}
+		if (faces.size() != 6)
+			return 0;
+
+		std::string cache = cubeCachePath(faces, format);
+		if (format != FORMAT_RGBA8 && fresh(cache, &faces[0], faces.size()) &&
+			readDDS(cache, format, 6, width, height, data))
+			return uploadCubemap(format, width, data, size);
+
+		// one job per different image (the tile box is one image six times)
+		struct Face
+		{
+			int width = 0, height = 0;
+			Levels levels;
+		};
+		std::vector<std::future<Face> > jobs;
+		int job_of[6];
+		std::map<std::string, int> started;
+		for (int i = 0; i < 6; i++)
+		{
+			std::map<std::string, int>::iterator found = started.find(faces[i]);
+			if (found != started.end())
+			{
+				job_of[i] = found->second;
+				continue;
+			}
+			std::string path = faces[i];
+			job_of[i] = started[path] = (int)jobs.size();
+			jobs.push_back(ThreadPool::shared().submit([path, format]() {
+				Face face;
+				cv::Mat img = cv::imread(path, cv::IMREAD_COLOR);
+				if (img.empty())
+				{
+					std::cout << "Cubemap texture failed to load at path: " << path << std::endl;
+					return face;
+				}
+				face.width = img.cols;
+				face.height = img.rows;
+				buildLevels(img, format, face.levels);
+				return face;
+			}));
+		}
+		std::vector<Face> done;
+		for (size_t i = 0; i < jobs.size(); i++)
+			done.push_back(jobs[i].get());
+
+		width = done[job_of[0]].width;
+		for (int i = 0; i < 6; i++)
+		{
+			const Face& face = done[job_of[i]];
+			if (!face.width || face.width != face.height || face.width != width)
+			{
+				std::cout << "ERROR::TEXTURE::CUBEMAP_FACES_NOT_SQUARE_AND_THE_SAME_SIZE " << faces[i] << std::endl;
+				return 0;
+			}
+			data.push_back(face.levels);
+		}
+
+		if (format != FORMAT_RGBA8 && !cacheDir().empty())
+			writeDDS(cache, format, width, width, data);
+		return uploadCubemap(format, width, data, size);
+	}
+
+	// how many mip levels a full chain has
+	static int levelCount(int width, int height)
+	{
+		int levels = 1;
+		for (int size = std::max(width, height); size > 1; size >>= 1)
+			levels++;
+		return levels;
+	}
+
+	// about how much video memory a texture of this format takes
+	// (uncompressed texels are counted as 4 bytes, like drivers keep them)
+	static size_t storageBytes(Format format, int width, int height, bool mipmaps = true)
+	{
+		int block_size = (format == FORMAT_BC5) ? 16 : 8;
+		size_t bytes = 0;
+		for (int i = mipmaps ? levelCount(width, height) : 1; i > 0; i--)
+		{
+			if (format == FORMAT_RGBA8)
+				bytes += (size_t)width * height * 4;
+			else
+				bytes += (size_t)((width + 3) / 4) * ((height + 3) / 4) * block_size;
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+		return bytes;
+	}
+
+	static GLenum internalFormat(Format format)
+	{
+		switch (format)
+		{
+		case FORMAT_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case FORMAT_BC4: return GL_COMPRESSED_RED_RGTC1;
+		case FORMAT_BC5: return GL_COMPRESSED_RG_RGTC2;
+		default: return GL_RGBA8;
+		}
+	}
+
+	// a copy of a 2D texture without its biggest level - a quarter of the
+	// memory. the other levels are copied down on the GPU (nothing is
+	// decoded or encoded again). 0 if it only has the one level; the
+	// texture given is left as it was either way
+	static GLuint dropTopLevel(GLuint id, glm::ivec2* size = nullptr, GLenum* format = nullptr, int* levels = nullptr)
+	{
+		GLint level_count = 0, internal_format = 0, width = 0, height = 0;
+		glBindTexture(GL_TEXTURE_2D, id);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_IMMUTABLE_LEVELS, &level_count);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internal_format);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 1, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 1, GL_TEXTURE_HEIGHT, &height);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		if (level_count < 2)
+			return 0;
+
+		GLuint smaller;
+		glGenTextures(1, &smaller);
+		glBindTexture(GL_TEXTURE_2D, smaller);
+		glTexStorage2D(GL_TEXTURE_2D, level_count - 1, (GLenum)internal_format, width, height);
+		setSampling();
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		if (size)
+			*size = glm::ivec2(width, height);
+		if (format)
+			*format = (GLenum)internal_format;
+		if (levels)
+			*levels = level_count - 1;
+		for (GLint i = 0; i + 1 < level_count; i++)
+		{
+			glCopyImageSubData(id, GL_TEXTURE_2D, i + 1, 0, 0, 0, smaller, GL_TEXTURE_2D, i, 0, 0, 0, width, height, 1);
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+		return smaller;
+	}
+
+private:
+	// box filter the whole chain down to 1x1, and encode every level
+	// (safe on any thread - no OpenGL)
+	static void buildLevels(const cv::Mat& img, Format format, Levels& levels)
+	{
+		cv::Mat level = img;
+		while (true)
+		{
+			levels.push_back(std::vector<unsigned char>());
+			encode(level, format, levels.back());
+			if (level.cols == 1 && level.rows == 1)
+				break;
+			cv::Mat next;
+			cv::resize(level, next, cv::Size(std::max(1, level.cols / 2), std::max(1, level.rows / 2)), 0, 0, cv::INTER_AREA);
+			level = next;
+		}
+	}
+
+	// compress a new texture (and cache it, if there is a path)
+	static GLuint build(const cv::Mat& img, Format format, const char* path)
+	{
+		Levels levels;
+		buildLevels(img, format, levels);
+
+		if (path)
+			writeCache(path, format, img.cols, img.rows, levels);
+		return uploadCompressed(format, img.cols, img.rows, levels);
+	}
+
+	static void setSampling()
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	}
+
+	static GLuint uploadUncompressed(const cv::Mat& img)
+	{
+		GLuint id;
+		glGenTextures(1, &id);
+		glBindTexture(GL_TEXTURE_2D, id);
+
+		bool alpha = img.type() == CV_8UC4;
+		glTexStorage2D(GL_TEXTURE_2D, levelCount(img.cols, img.rows), alpha ? GL_RGBA8 : GL_RGB8, img.cols, img.rows);
+		// opencv rows are packed, not padded to 4 bytes
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, img.cols, img.rows, alpha ? GL_BGRA : GL_BGR, GL_UNSIGNED_BYTE, img.data);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glGenerateMipmap(GL_TEXTURE_2D);
+		setSampling();
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return id;
+	}
+
+	// all of the faces go into one pixel buffer, so the driver gets them 
+	// in one copy and can upload them without stalling us
+	static GLuint uploadCubemap(Format format, int width, const std::vector<Levels>& data, int* size)
+	{
+		size_t total = 0;
+		for (size_t f = 0; f < data.size(); f++)
+			for (size_t i = 0; i < data[f].size(); i++)
+				total += data[f][i].size();
+
+		GLuint pbo;
+		glGenBuffers(1, &pbo);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, total, nullptr, GL_STREAM_DRAW);
+		unsigned char* dst = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, total, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		for (size_t f = 0; f < data.size(); f++)
+			for (size_t i = 0; i < data[f].size(); i++)
+			{
+				memcpy(dst, &data[f][i][0], data[f][i].size());
+				dst += data[f][i].size();
+			}
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		GLuint id;
+		glGenTextures(1, &id);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, id);
+		glTexStorage2D(GL_TEXTURE_CUBE_MAP, (GLsizei)data[0].size(), internalFormat(format), width, width);
+		size_t offset = 0;
+		for (size_t f = 0; f < data.size(); f++)
+		{
+			int w = width;
+			for (size_t i = 0; i < data[f].size(); i++)
+			{
+				GLenum face = GL_TEXTURE_CUBE_MAP_POSITIVE_X + (GLenum)f;
+				if (format == FORMAT_RGBA8)
+					glTexSubImage2D(face, (GLint)i, 0, 0, w, w, GL_BGRA, GL_UNSIGNED_BYTE, (const void*)offset);
+				else
+					glCompressedTexSubImage2D(face, (GLint)i, 0, 0, w, w, internalFormat(format), (GLsizei)data[f][i].size(), (const void*)offset);
+				offset += data[f][i].size();
+				w = std::max(1, w / 2);
+			}
+		}
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glDeleteBuffers(1, &pbo);
+
+		if (size)
+			*size = width;
+		return id;
+	}
+
+	static GLuint uploadCompressed(Format format, int width, int height, const Levels& levels)
+	{
+		GLuint id;
+		glGenTextures(1, &id);
+		glBindTexture(GL_TEXTURE_2D, id);
+
+		glTexStorage2D(GL_TEXTURE_2D, (GLsizei)levels.size(), internalFormat(format), width, height);
+		for (size_t i = 0; i < levels.size(); i++)
+		{
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)i, 0, 0, width, height,
+				internalFormat(format), (GLsizei)levels[i].size(), &levels[i][0]);
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+		setSampling();
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return id;
+	}
+
+	//
+	// block encoding
+	//
+	// a 4x4 block of one channel, fetched with the edges clamped
+	static void fetchBlock(const cv::Mat& img, int bx, int by, int channel, unsigned char out[16])
+	{
+		int channels = img.channels();
+		for (int y = 0; y < 4; y++)
+		{
+			const unsigned char* row = img.ptr<unsigned char>(std::min(by + y, img.rows - 1));
+			for (int x = 0; x < 4; x++)
+				out[y * 4 + x] = row[std::min(bx + x, img.cols - 1) * channels + std::min(channel, channels - 1)];
+		}
+	}
+
+	// one BC4 block (8 bytes): two end points and 3 bit indices between them
+	static void encodeBC4(const unsigned char v[16], unsigned char* out)
+	{
+		int lo = 255, hi = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			lo = std::min(lo, (int)v[i]);
+			hi = std::max(hi, (int)v[i]);
+		}
+		out[0] = (unsigned char)hi;
+		out[1] = (unsigned char)lo;
+
+		uint64_t bits = 0;
+		if (hi > lo)
+		{
+			// 8 values: index 0 is hi, 1 is lo, 2..7 step from hi to lo
+			for (int i = 0; i < 16; i++)
+			{
+				int step = ((v[i] - lo) * 14 + (hi - lo)) / (2 * (hi - lo));	// 0 (lo) .. 7 (hi)
+				int index = (step == 7) ? 0 : (step == 0) ? 1 : 8 - step;
+				bits |= (uint64_t)index << (3 * i);
+			}
+		}
+		for (int i = 0; i < 6; i++)
+			out[2 + i] = (unsigned char)(bits >> (8 * i));
+	}
+
+	static int to565(int r, int g, int b)
+	{
+		return ((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255);
+	}
+	static void from565(int c, int rgb[3])
+	{
+		rgb[0] = ((c >> 11) & 31) * 255 / 31;
+		rgb[1] = ((c >> 5) & 63) * 255 / 63;
+		rgb[2] = (c & 31) * 255 / 31;
+	}
+
+	// one BC1 block (8 bytes): the bounding box of the colors, pulled in a
+	// little, as the end points and 2 bit indices to the nearest of the 4
+	static void encodeBC1(const unsigned char r[16], const unsigned char g[16], const unsigned char b[16], unsigned char* out)
+	{
+		int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+		const unsigned char* c[3] = { r, g, b };
+		for (int k = 0; k < 3; k++)
+			for (int i = 0; i < 16; i++)
+			{
+				lo[k] = std::min(lo[k], (int)c[k][i]);
+				hi[k] = std::max(hi[k], (int)c[k][i]);
+			}
+		for (int k = 0; k < 3; k++)
+		{
+			int inset = (hi[k] - lo[k]) / 16;
+			lo[k] += inset;
+			hi[k] -= inset;
+		}
+
+		// the colors may run along any diagonal of the box - flip the
+		// channels that go down while the widest one goes up
+		int widest = 0;
+		for (int k = 1; k < 3; k++)
+			if (hi[k] - lo[k] > hi[widest] - lo[widest])
+				widest = k;
+		int mean[3] = { 0, 0, 0 };
+		for (int k = 0; k < 3; k++)
+		{
+			for (int i = 0; i < 16; i++)
+				mean[k] += c[k][i];
+			mean[k] /= 16;
+		}
+		for (int k = 0; k < 3; k++)
+		{
+			int cov = 0;
+			for (int i = 0; i < 16; i++)
+				cov += (c[k][i] - mean[k]) * (c[widest][i] - mean[widest]);
+			if (cov < 0)
+				std::swap(lo[k], hi[k]);
+		}
+
+		int c0 = to565(hi[0], hi[1], hi[2]);
+		int c1 = to565(lo[0], lo[1], lo[2]);
+		// c0 > c1 picks the 4 color mode
+		if (c0 < c1)
+			std::swap(c0, c1);
+
+		unsigned int bits = 0;
+		if (c0 != c1)
+		{
+			int palette[4][3];
+			from565(c0, palette[0]);
+			from565(c1, palette[1]);
+			for (int k = 0; k < 3; k++)
+			{
+				palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+				palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+			}
+			for (int i = 0; i < 16; i++)
+			{
+				int best = 0, best_dist = INT_MAX;
+				for (int p = 0; p < 4; p++)
+				{
+					int dr = r[i] - palette[p][0], dg = g[i] - palette[p][1], db = b[i] - palette[p][2];
+					int dist = dr * dr + dg * dg + db * db;
+					if (dist < best_dist)
+					{
+						best_dist = dist;
+						best = p;
+					}
+				}
+				bits |= best << (2 * i);
+			}
+		}
+		out[0] = (unsigned char)c0;
+		out[1] = (unsigned char)(c0 >> 8);
+		out[2] = (unsigned char)c1;
+		out[3] = (unsigned char)(c1 >> 8);
+		for (int i = 0; i < 4; i++)
+			out[4 + i] = (unsigned char)(bits >> (8 * i));
+	}
+
+	// encode one mip level (opencv keeps blue first)
+	// uncompressed levels come out as BGRA
+	static void encode(const cv::Mat& img, Format format, std::vector<unsigned char>& out)
+	{
+		if (format == FORMAT_RGBA8)
+		{
+			int channels = img.channels();
+			out.resize((size_t)img.cols * img.rows * 4);
+			unsigned char* dst = &out[0];
+			for (int y = 0; y < img.rows; y++)
+			{
+				const unsigned char* row = img.ptr<unsigned char>(y);
+				for (int x = 0; x < img.cols; x++, dst += 4, row += channels)
+				{
+					dst[0] = row[0];
+					dst[1] = row[std::min(1, channels - 1)];
+					dst[2] = row[std::min(2, channels - 1)];
+					dst[3] = (channels == 4) ? row[3] : 255;
+				}
+			}
+			return;
+		}
+
+		int bw = (img.cols + 3) / 4, bh = (img.rows + 3) / 4;
+		int block_size = (format == FORMAT_BC5) ? 16 : 8;
+		out.resize((size_t)bw * bh * block_size);
+
+		unsigned char* dst = &out[0];
+		unsigned char r[16], g[16], b[16];
+		for (int by = 0; by < bh; by++)
+			for (int bx = 0; bx < bw; bx++, dst += block_size)
+			{
+				fetchBlock(img, bx * 4, by * 4, 2, r);
+				if (format == FORMAT_BC4)
+				{
+					encodeBC4(r, dst);
+					continue;
+				}
+				fetchBlock(img, bx * 4, by * 4, 1, g);
+				if (format == FORMAT_BC5)
+				{
+					encodeBC4(r, dst);
+					encodeBC4(g, dst + 8);
+					continue;
+				}
+				fetchBlock(img, bx * 4, by * 4, 0, b);
+				encodeBC1(r, g, b, dst);
+			}
+	}
+
+public:
+	//
+	// the .dds cache
+	//
+	static const char* fourCC(Format format)
+	{
+		switch (format)
+		{
+		case FORMAT_BC1: return "DXT1";
+		case FORMAT_BC4: return "ATI1";
+		default: return "ATI2";
+		}
+	}
+
+	static std::string cachePath(const char* path, Format format)
+	{
+		std::string name = path;
+		for (size_t i = 0; i < name.size(); i++)
+			if (name[i] == '/' || name[i] == '\\' || name[i] == ':')
+				name[i] = '_';
+		static const char* suffix[] = { "", ".bc1.dds", ".bc4.dds", ".bc5.dds" };
+		return cacheDir() + "/" + name + suffix[format];
+	}
+
+	// six paths make a long name - use a hash of them instead
+	static std::string cubeCachePath(const std::vector<const char*>& faces, Format format)
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		for (size_t i = 0; i < faces.size(); i++)
+			for (const char* c = faces[i]; ; c++)
+			{
+				hash ^= (unsigned char)*c;
+				hash *= 1099511628211ULL;
+				if (!*c)
+					break;
+			}
+		char name[32];
+		sprintf(name, "cube_%016llx", (unsigned long long)hash);
+		return cachePath(name, format);
+	}
+
+	static bool modifiedTime(const std::string& path, time_t& time)
+	{
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0)
+			return false;
+		time = info.st_mtime;
+		return true;
+	}
+
+	// the cache file exists and none of its images are newer
+	static bool fresh(const std::string& cache, const char* const* sources, size_t count)
+	{
+		time_t cache_time, source_time;
+		if (cacheDir().empty() || !modifiedTime(cache, cache_time))
+			return false;
+		for (size_t i = 0; i < count; i++)
+			if (modifiedTime(sources[i], source_time) && source_time > cache_time)
+				return false;
+		return true;
+	}
+
+	// the DDS header, without the "DDS " in front of it
+	struct DDSHeader
+	{
+		uint32_t size, flags, height, width, linear_size, depth, mip_count;
+		uint32_t reserved[11];
+		uint32_t pf_size, pf_flags;
+		char pf_fourcc[4];
+		uint32_t pf_bits, pf_masks[4];
+		uint32_t caps, caps2, caps3, caps4, reserved2;
+	};
+	enum {
+		DDPF_RGB = 0x40,
+		DDPF_ALPHAPIXELS = 0x1,
+		DDPF_FOURCC = 0x4,
+		DDS_CUBEMAP_ALL_FACES = 0x200 | 0xFC00,
+	};
+
+	// read a .dds (block compressed, or BGRA for FORMAT_RGBA8) - one face, 
+	// or a cubemap (each face with all of its levels, +x first)
+	static bool readDDS(const std::string& path, Format format, int faces, int& width, int& height, std::vector<Levels>& data)
+	{
+		FILE* file = fopen(path.c_str(), "rb");
+		if (!file)
+			return false;
+		char magic[4];
+		DDSHeader header;
+		bool ok = fread(magic, 4, 1, file) == 1 && fread(&header, sizeof(header), 1, file) == 1 &&
+			!memcmp(magic, "DDS ", 4) &&
+			((format == FORMAT_RGBA8) ? (header.pf_flags & DDPF_RGB) && header.pf_bits == 32 : !memcmp(header.pf_fourcc, fourCC(format), 4)) &&
+			header.mip_count >= 1 && header.mip_count <= (uint32_t)levelCount(header.width, header.height) &&
+			(faces == 6) == ((header.caps2 & DDS_CUBEMAP_ALL_FACES) == DDS_CUBEMAP_ALL_FACES);
+
+		data.assign(faces, Levels());
+		for (int f = 0; ok && f < faces; f++)
+		{
+			int w = header.width, h = header.height;
+			for (uint32_t i = 0; ok && i < header.mip_count; i++)
+			{
+				data[f].push_back(std::vector<unsigned char>(storageBytes(format, w, h, false)));
+				ok = fread(&data[f].back()[0], data[f].back().size(), 1, file) == 1;
+				w = std::max(1, w / 2);
+				h = std::max(1, h / 2);
+			}
+		}
+		fclose(file);
+
+		width = header.width;
+		height = header.height;
+		return ok;
+	}
+
+	static void writeDDS(const std::string& path, Format format, int width, int height, const std::vector<Levels>& data)
+	{
+#ifdef _WIN32
+		_mkdir(cacheDir().c_str());
+#else
+		mkdir(cacheDir().c_str(), 0755);
+#endif
+		FILE* file = fopen(path.c_str(), "wb");
+		if (!file)
+			return;
+
+		DDSHeader header;
+		memset(&header, 0, sizeof(header));
+		header.size = 124;
+		header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000;	// caps, height, width, pixel format, mip count
+		header.height = height;
+		header.width = width;
+		header.mip_count = (uint32_t)data[0].size();
+		header.pf_size = 32;
+		if (format == FORMAT_RGBA8)
+		{
+			header.flags |= 0x8;	// pitch
+			header.linear_size = width * 4;
+			header.pf_flags = DDPF_RGB | DDPF_ALPHAPIXELS;
+			header.pf_bits = 32;
+			header.pf_masks[0] = 0x00ff0000;
+			header.pf_masks[1] = 0x0000ff00;
+			header.pf_masks[2] = 0x000000ff;
+			header.pf_masks[3] = 0xff000000;
+		}
+		else
+		{
+			header.flags |= 0x80000;	// linear size
+			header.linear_size = (uint32_t)data[0][0].size();
+			header.pf_flags = DDPF_FOURCC;
+			memcpy(header.pf_fourcc, fourCC(format), 4);
+		}
+		header.caps = 0x1000 | 0x400000 | 0x8;	// texture, mipmap, complex
+		if (data.size() == 6)
+			header.caps2 = DDS_CUBEMAP_ALL_FACES;
+
+		fwrite("DDS ", 4, 1, file);
+		fwrite(&header, sizeof(header), 1, file);
+		for (size_t f = 0; f < data.size(); f++)
+			for (size_t i = 0; i < data[f].size(); i++)
+				fwrite(&data[f][i][0], data[f][i].size(), 1, file);
+		fclose(file);
+	}
+
+	static GLuint loadCache(const char* path, Format format, glm::ivec2* size)
+	{
+		std::string cache = cachePath(path, format);
+		if (!fresh(cache, &path, 1))
+			return 0;
+
+		std::vector<Levels> data;
+		int width, height;
+		if (!readDDS(cache, format, 1, width, height, data))
+			return 0;
+
+		if (size)
+			*size = glm::ivec2(width, height);
+		return uploadCompressed(format, width, height, data[0]);
+	}
+
+	static void writeCache(const char* path, Format format, int width, int height, const Levels& levels)
+	{
+		if (cacheDir().empty())
+			return;
+		writeDDS(cachePath(path, format), format, width, height, std::vector<Levels>(1, levels));
+	}
+};
@@ -0,0 +1,118 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <cstring>
+
+#include "GpuResources.h"
+
+// Reads the red channel of a texture back to the CPU without waiting for
+// it: read starts a copy into one of two pixel pack buffers (it returns
+// straight away - the GPU does the copy), and a later collect, once the
+// copy's fence has passed, copies the floats out. what comes out is a
+// frame or two old.
+// if both buffers are still in flight, a read is skipped.
+// everything is called on the thread with the context
+class TextureReadback
+{
+public:
+	~TextureReadback()
+	{
+		release();
+	}
+
+	// the size of what is read, and who it is for (GpuResources)
+	void init(int width, int height, const char* owner)
+	{
+		this->width = width;
+		this->height = height;
+		GLsizeiptr bytes = (GLsizeiptr)width * height * sizeof(float);
+		for (int i = 0; i < slotCount; i++)
+		{
+			glGenBuffers(1, &this->slots[i].pbo);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, this->slots[i].pbo);
+			glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+			GpuResources::instance().buffer(this->slots[i].pbo, owner, "readback", (size_t)bytes);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	bool ready() const
+	{
+		return this->slots[0].pbo != 0;
+	}
+
+	// start copying level 0 of texture (width x height)
+	void read(GLuint texture)
+	{
+		Slot& slot = this->slots[this->next];
+		if (slot.fence)
+			return;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glGetTextureImage(texture, 0, GL_RED, GL_FLOAT, (GLsizei)(this->width * this->height * sizeof(float)), nullptr);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		this->next = (this->next + 1) % slotCount;
+	}
+
+	// the newest copy that has arrived since the last collect, into out
+	// (width x height floats, the texture's rows bottom first). false if
+	// none has
+	bool collect(float* out)
+	{
+		bool got = false;
+		while (this->slots[this->oldest].fence)
+		{
+			Slot& slot = this->slots[this->oldest];
+			GLenum result = glClientWaitSync(slot.fence, 0, 0);
+			if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+				break;
+			glDeleteSync(slot.fence);
+			slot.fence = 0;
+
+			size_t bytes = (size_t)this->width * this->height * sizeof(float);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+			const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)bytes, GL_MAP_READ_BIT);
+			if (mapped)
+			{
+				memcpy(out, mapped, bytes);
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+				got = true;
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			this->oldest = (this->oldest + 1) % slotCount;
+		}
+		return got;
+	}
+
+private:
+	static const int slotCount = 2;
+
+	struct Slot
+	{
+		GLuint pbo = 0;
+		GLsync fence = 0;	// the copy in flight (0: free)
+	};
+
+	void release()
+	{
+		for (int i = 0; i < slotCount; i++)
+		{
+			Slot& slot = this->slots[i];
+			if (slot.fence)
+				glDeleteSync(slot.fence);
+			slot.fence = 0;
+			if (slot.pbo)
+			{
+				glDeleteBuffers(1, &slot.pbo);
+				GpuResources::instance().forget(GpuResources::KIND_BUFFER, slot.pbo);
+			}
+			slot.pbo = 0;
+		}
+	}
+
+	Slot slots[slotCount];
+	int next = 0;		// where the next read goes
+	int oldest = 0;		// the read to collect first
+	int width = 0, height = 0;
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <vector>
+#include <algorithm>
+
+// A fixed set of worker threads for loading work (decoding, encoding,
+// filtering). submit returns a future for the result.
+// jobs must not touch OpenGL - the context belongs to the thread drawing
+class ThreadPool
+{
+public:
+	explicit ThreadPool(unsigned int threads = 0)
+	{
+		if (!threads)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned int i = 0; i < threads; i++)
+			this->workers.push_back(std::thread(&ThreadPool::work, this));
+	}
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->stopping = true;
+		}
+		this->wake.notify_all();
+		for (size_t i = 0; i < this->workers.size(); i++)
+			this->workers[i].join();
+	}
+
+	// the pool everything shares
+	static ThreadPool& shared()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+	template <class F>
+	std::future<decltype(std::declval<F&>()())> submit(F job)
+	{
+		typedef decltype(std::declval<F&>()()) Result;
+		std::shared_ptr<std::packaged_task<Result()> > task(new std::packaged_task<Result()>(job));
+		std::future<Result> result = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->jobs.push([task]() { (*task)(); });
+		}
+		this->wake.notify_one();
+		return result;
+	}
+
+	size_t size() const
+	{
+		return this->workers.size();
+	}
+
+private:
+	void work()
+	{
+		while (true)
+		{
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(this->mutex);
+				this->wake.wait(lock, [this]() { return this->stopping || !this->jobs.empty(); });
+				if (this->jobs.empty())
+					return;
+				job = this->jobs.front();
+				this->jobs.pop();
+			}
+			job();
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()> > jobs;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+};
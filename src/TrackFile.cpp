@@ -0,0 +1,405 @@
+/************************************************************************
+     File:        TrackFile.cpp
+
+     Comment:     Reading and writing the control points of a track
+
+						Both formats are read out of the file mapped into
+						memory - the text one parsed in place, the binary
+						one copied from its arrays.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <string.h>
+#include <algorithm>
+#include <charconv>
+
+#ifdef _WIN32
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#else
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
+#include "TrackFile.H"
+
+static const char binaryMagic[4] = { 'T', 'R', 'K', 'B' };
+// where the binary format's arrays start (a multiple of, from the file's start)
+static const uint64_t arrayAlignment = 64;
+
+//****************************************************************************
+//
+// * A file mapped read-only, for as long as this is around
+//============================================================================
+class MappedFile {
+	public:
+		MappedFile() : data(nullptr), size(0)
+#ifdef _WIN32
+			, file(INVALID_HANDLE_VALUE), mapping(NULL)
+#else
+			, fd(-1)
+#endif
+		{
+		}
+
+		~MappedFile()
+		{
+#ifdef _WIN32
+			if (data && size)
+				UnmapViewOfFile(data);
+			if (mapping)
+				CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE)
+				CloseHandle(file);
+#else
+			if (data && size)
+				munmap((void*) data, size);
+			if (fd >= 0)
+				close(fd);
+#endif
+		}
+
+		bool open(const char* filename)
+		{
+#ifdef _WIN32
+			file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+									 FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			if (file == INVALID_HANDLE_VALUE)
+				return false;
+			LARGE_INTEGER bytes;
+			if (!GetFileSizeEx(file, &bytes))
+				return false;
+			size = (size_t) bytes.QuadPart;
+			// an empty file can't be mapped (and there is nothing to map)
+			if (!size) {
+				data = "";
+				return true;
+			}
+			mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (!mapping)
+				return false;
+			data = (const char*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+			fd = ::open(filename, O_RDONLY);
+			if (fd < 0)
+				return false;
+			struct stat info;
+			if (fstat(fd, &info))
+				return false;
+			size = (size_t) info.st_size;
+			if (!size) {
+				data = "";
+				return true;
+			}
+			void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			data = (mapped == MAP_FAILED) ? nullptr : (const char*) mapped;
+#endif
+			return data != nullptr;
+		}
+
+	public:
+		const char*	data;
+		size_t		size;
+
+	private:
+#ifdef _WIN32
+		HANDLE		file;
+		HANDLE		mapping;
+#else
+		int			fd;
+#endif
+};
+
+//============================================================================
+TrackFile::Format TrackFile::
+formatOf(const char* filename)
+//============================================================================
+{
+	size_t length = strlen(filename);
+	if (length >= 4 && !strcmp(filename + length - 4, ".trk"))
+		return Binary;
+	return Text;
+}
+
+//****************************************************************************
+//
+// * Map the file, and read it as whichever format its first bytes say
+//============================================================================
+bool TrackFile::
+read(const char* filename, std::vector<ControlPoint>& points, std::string& error)
+//============================================================================
+{
+	MappedFile file;
+	if (!file.open(filename)) {
+		error = std::string("Can't open ") + filename;
+		return false;
+	}
+	if (file.size >= sizeof(binaryMagic) && !memcmp(file.data, binaryMagic, sizeof(binaryMagic)))
+		return readBinary(file.data, file.size, points, error);
+	return readText(file.data, file.size, points, error);
+}
+
+//****************************************************************************
+//
+// * The text format: the number of points, then x y z [ox oy oz [tag]]
+//   per line. blank lines and anything after a # are skipped. a line with
+//   fewer than 3 numbers is a point at the origin, fewer than 6 one
+//   pointing up (as it has always been)
+//============================================================================
+bool TrackFile::
+readText(const char* data, size_t size, std::vector<ControlPoint>& points, std::string& error)
+//============================================================================
+{
+	const char* p = data;
+	const char* end = data + size;
+	auto skipSpace = [&p, end]() {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			++p;
+	};
+	auto skipLine = [&p, end]() {
+		while (p < end && *p != '\n')
+			++p;
+		if (p < end)
+			++p;
+	};
+
+	// first line = number of points
+	skipSpace();
+	unsigned long long count = 0;
+	std::from_chars_result first = std::from_chars(p, end, count);
+	if (first.ec != std::errc()) {
+		error = "The first line should be the number of points";
+		return false;
+	}
+	p = first.ptr;
+	skipLine();
+	if (count < 4) {
+		error = "A track needs at least 4 points";
+		return false;
+	}
+
+	std::vector<ControlPoint> read;
+	// a point takes at least 6 characters ("0 0 0\n") - don't trust a
+	// count bigger than the file could hold
+	read.reserve((size_t) std::min<unsigned long long>(count, size / 6 + 1));
+
+	int line = 1;
+	while (p < end && read.size() < count) {
+		++line;
+		float values[6];
+		unsigned int tag = 0;
+		int numbers = 0;
+		while (true) {
+			skipSpace();
+			if (p == end || *p == '\n' || *p == '#')
+				break;
+			std::from_chars_result result;
+			if (numbers < 6)
+				result = std::from_chars(p, end, values[numbers]);
+			else if (numbers == 6)
+				result = std::from_chars(p, end, tag);
+			else {
+				// more than there are fields for - ignored
+				while (p < end && *p > ' ')
+					++p;
+				continue;
+			}
+			if (result.ec != std::errc()) {
+				error = "Line " + std::to_string(line) + " isn't a list of numbers";
+				return false;
+			}
+			p = result.ptr;
+			++numbers;
+		}
+		skipLine();
+		if (!numbers)
+			continue;
+
+		ControlPoint cp;
+		if (numbers >= 3)
+			cp.pos = Pnt3f(values[0], values[1], values[2]);
+		if (numbers >= 6) {
+			cp.orient = Pnt3f(values[3], values[4], values[5]);
+			cp.orient.normalize();
+		}
+		cp.tag = tag;
+		read.push_back(cp);
+	}
+
+	if (read.size() < 4) {
+		error = "A track needs at least 4 points";
+		return false;
+	}
+	points.swap(read);
+	return true;
+}
+
+//****************************************************************************
+//
+// * The binary format: check the header and that every array is inside
+//   the file, then copy the arrays into the points
+//============================================================================
+bool TrackFile::
+readBinary(const char* data, size_t size, std::vector<ControlPoint>& points, std::string& error)
+//============================================================================
+{
+	Header header;
+	if (size < sizeof(header)) {
+		error = "The file is too short for a binary track";
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+	if (header.version != version) {
+		error = "The binary track is version " + std::to_string(header.version) +
+			", this reads version " + std::to_string(version);
+		return false;
+	}
+	if (header.header_size < sizeof(header) || header.header_size > size) {
+		error = "The binary track's header is damaged";
+		return false;
+	}
+	if (header.count < 4) {
+		error = "A track needs at least 4 points";
+		return false;
+	}
+
+	int arrays = (header.flags & hasTags) ? 7 : 6;
+	for (int a = 0; a < arrays; ++a) {
+		uint64_t offset = header.offsets[a];
+		if (offset < header.header_size || offset % 4 || offset > size ||
+			 header.count > (size - offset) / 4) {
+			error = "The binary track is cut short or damaged";
+			return false;
+		}
+	}
+
+	// mapped at a page boundary, so 4 byte aligned offsets are aligned floats
+	const float* pos[3];
+	const float* orient[3];
+	for (int c = 0; c < 3; ++c) {
+		pos[c] = (const float*) (data + header.offsets[c]);
+		orient[c] = (const float*) (data + header.offsets[3 + c]);
+	}
+	const uint32_t* tags = (arrays == 7) ? (const uint32_t*) (data + header.offsets[6]) : nullptr;
+
+	size_t count = (size_t) header.count;
+	points.resize(count);
+	for (size_t i = 0; i < count; ++i) {
+		ControlPoint& cp = points[i];
+		cp.pos.x = pos[0][i];
+		cp.pos.y = pos[1][i];
+		cp.pos.z = pos[2][i];
+		cp.orient.x = orient[0][i];
+		cp.orient.y = orient[1][i];
+		cp.orient.z = orient[2][i];
+		cp.tag = tags ? tags[i] : 0;
+	}
+	return true;
+}
+
+//****************************************************************************
+//
+// * Write in the format asked for
+//============================================================================
+bool TrackFile::
+write(const char* filename, const std::vector<ControlPoint>& points, Format format, std::string& error)
+//============================================================================
+{
+	FILE* file = fopen(filename, (format == Binary) ? "wb" : "w");
+	if (!file) {
+		error = std::string("Can't open ") + filename + " for writing";
+		return false;
+	}
+	bool written = (format == Binary) ? writeBinary(file, points) : writeText(file, points);
+	if (fclose(file) || !written) {
+		error = std::string("Couldn't write all of ") + filename;
+		return false;
+	}
+	return true;
+}
+
+//****************************************************************************
+//
+// * 9 significant digits - enough for every float to read back the same
+//============================================================================
+bool TrackFile::
+writeText(FILE* file, const std::vector<ControlPoint>& points)
+//============================================================================
+{
+	bool ok = fprintf(file, "%lu\n", (unsigned long) points.size()) > 0;
+	for (size_t i = 0; i < points.size() && ok; ++i) {
+		const ControlPoint& cp = points[i];
+		ok = fprintf(file, "%.9g %.9g %.9g %.9g %.9g %.9g",
+			cp.pos.x, cp.pos.y, cp.pos.z, cp.orient.x, cp.orient.y, cp.orient.z) > 0;
+		if (ok && cp.tag)
+			ok = fprintf(file, " %u", cp.tag) > 0;
+		if (ok)
+			ok = fputc('\n', file) != EOF;
+	}
+	return ok;
+}
+
+//****************************************************************************
+//
+// * The header, then each array at the next multiple of arrayAlignment
+//============================================================================
+bool TrackFile::
+writeBinary(FILE* file, const std::vector<ControlPoint>& points)
+//============================================================================
+{
+	bool tagged = false;
+	for (size_t i = 0; i < points.size() && !tagged; ++i)
+		tagged = points[i].tag != 0;
+
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, binaryMagic, sizeof(binaryMagic));
+	header.version = version;
+	header.header_size = sizeof(header);
+	header.flags = tagged ? hasTags : 0;
+	header.count = points.size();
+
+	int arrays = tagged ? 7 : 6;
+	uint64_t offset = sizeof(header);
+	for (int a = 0; a < arrays; ++a) {
+		offset = (offset + arrayAlignment - 1) / arrayAlignment * arrayAlignment;
+		header.offsets[a] = offset;
+		offset += points.size() * 4;
+	}
+	if (fwrite(&header, sizeof(header), 1, file) != 1)
+		return false;
+
+	// one array at a time, gathered out of the points
+	std::vector<uint32_t> column(points.size());
+	uint64_t at = sizeof(header);
+	for (int a = 0; a < arrays; ++a) {
+		static const char padding[arrayAlignment] = { 0 };
+		if (fwrite(padding, 1, (size_t) (header.offsets[a] - at), file) != header.offsets[a] - at)
+			return false;
+		for (size_t i = 0; i < points.size(); ++i) {
+			const ControlPoint& cp = points[i];
+			float value = 0;
+			switch (a) {
+				case 0: value = cp.pos.x;		break;
+				case 1: value = cp.pos.y;		break;
+				case 2: value = cp.pos.z;		break;
+				case 3: value = cp.orient.x;	break;
+				case 4: value = cp.orient.y;	break;
+				case 5: value = cp.orient.z;	break;
+			}
+			if (a == 6)
+				column[i] = cp.tag;
+			else
+				memcpy(&column[i], &value, 4);
+		}
+		if (!column.empty() && fwrite(&column[0], 4, column.size(), file) != column.size())
+			return false;
+		at = header.offsets[a] + points.size() * 4;
+	}
+	return true;
+}
@@ -0,0 +1,168 @@
+/************************************************************************
+     File:        TrackMesh.cpp
+
+     Comment:     The rails and ties of the track, as triangles
+
+						Only the segments the spline measured again are
+						tessellated again.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <algorithm>
+
+#include "TrackMesh.H"
+#include "TrackSpline.H"
+
+// the shape of the track, in world units
+static const float railGauge = 4.0f;		// between the rails' middles
+static const float railWidth = 0.6f;
+static const float railHeight = 0.6f;		// above the ties
+static const float tieLength = 6.0f;		// across the track
+static const float tieDepth = 1.2f;			// along it
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+TrackMesh::
+TrackMesh()
+	: segment_count(0), spline_revision(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * Tessellate the segments the spline changed and remember them as pending
+//============================================================================
+bool TrackMesh::
+update(const TrackSpline& spline)
+//============================================================================
+{
+	if (spline.revision() == spline_revision)
+		return false;
+	spline_revision = spline.revision();
+
+	int count = spline.segments();
+	if (count != segment_count) {
+		// every block is new - whatever was pending is in the new ones
+		segment_count = count;
+		vertices.resize(count * verticesPerSegment);
+		pending.clear();
+		is_pending.assign(count, false);
+	}
+
+	const std::vector<int>& changed = spline.changed();
+	for (size_t i = 0; i < changed.size(); ++i) {
+		int segment = changed[i];
+		tessellate(spline, segment);
+		if (!is_pending[segment]) {
+			is_pending[segment] = true;
+			pending.push_back(segment);
+		}
+	}
+	std::sort(pending.begin(), pending.end());
+	return !changed.empty();
+}
+
+//****************************************************************************
+//
+// * One segment's block: the rails' edges at each sample, then the ties
+//============================================================================
+void TrackMesh::
+tessellate(const TrackSpline& spline, int segment)
+//============================================================================
+{
+	TrackSpline::Frame frames[samplesPerSegment];
+	spline.segmentFrames(segment, samplesPerSegment, frames);
+
+	Vertex* out = &vertices[segment * verticesPerSegment];
+	auto put = [&out](const glm::vec3& p, const glm::vec3& n, float tie) {
+		out->position[0] = p.x;	out->position[1] = p.y;	out->position[2] = p.z;
+		out->normal[0] = n.x;	out->normal[1] = n.y;	out->normal[2] = n.z;
+		out->tie = tie;
+		++out;
+	};
+
+	// each sample: left rail (outer, inner edge), right rail (inner, outer)
+	for (int k = 0; k < samplesPerSegment; ++k) {
+		const TrackSpline::Frame& f = frames[k];
+		glm::vec3 side = glm::cross(f.tangent, f.up);
+		glm::vec3 top = f.position + railHeight * f.up;
+		float edges[4] = {
+			-railGauge / 2 - railWidth / 2, -railGauge / 2 + railWidth / 2,
+			 railGauge / 2 - railWidth / 2,  railGauge / 2 + railWidth / 2
+		};
+		for (int e = 0; e < 4; ++e)
+			put(top + edges[e] * side, f.up, 0.0f);
+	}
+
+	// the ties, evenly spread over the samples
+	for (int i = 0; i < tiesPerSegment; ++i) {
+		const TrackSpline::Frame& f = frames[i * samplesPerSegment / tiesPerSegment];
+		glm::vec3 side = glm::cross(f.tangent, f.up) * (tieLength / 2);
+		glm::vec3 along = f.tangent * (tieDepth / 2);
+		put(f.position - side - along, f.up, 1.0f);
+		put(f.position + side - along, f.up, 1.0f);
+		put(f.position + side + along, f.up, 1.0f);
+		put(f.position - side + along, f.up, 1.0f);
+	}
+}
+
+//****************************************************************************
+//
+// * The pending blocks, one after the other
+//============================================================================
+void TrackMesh::
+pendingVertices(std::vector<Vertex>& out) const
+//============================================================================
+{
+	out.resize(pending.size() * verticesPerSegment);
+	for (size_t i = 0; i < pending.size(); ++i)
+		std::copy(vertices.begin() + pending[i] * verticesPerSegment,
+					 vertices.begin() + (pending[i] + 1) * verticesPerSegment,
+					 out.begin() + i * verticesPerSegment);
+}
+
+void TrackMesh::
+clearPending()
+{
+	for (size_t i = 0; i < pending.size(); ++i)
+		is_pending[pending[i]] = false;
+	pending.clear();
+}
+
+//****************************************************************************
+//
+// * The triangles: each rail strip from every sample to the next (the last
+//   one to the next segment's first), and two per tie
+//============================================================================
+void TrackMesh::
+indices(int segments, std::vector<unsigned int>& out)
+//============================================================================
+{
+	out.resize((size_t) segments * indicesPerSegment);
+	unsigned int* index = out.empty() ? nullptr : &out[0];
+	for (int segment = 0; segment < segments; ++segment) {
+		unsigned int base = segment * verticesPerSegment;
+		unsigned int next_base = ((segment + 1) % segments) * verticesPerSegment;
+		for (int k = 0; k < samplesPerSegment; ++k) {
+			unsigned int here = base + k * 4;
+			unsigned int there = (k + 1 < samplesPerSegment) ? here + 4 : next_base;
+			// the left rail is edges 0-1, the right one 2-3
+			for (int rail = 0; rail < 4; rail += 2) {
+				unsigned int a = here + rail, b = here + rail + 1;
+				unsigned int c = there + rail + 1, d = there + rail;
+				*index++ = a; *index++ = b; *index++ = c;
+				*index++ = a; *index++ = c; *index++ = d;
+			}
+		}
+		for (int i = 0; i < tiesPerSegment; ++i) {
+			unsigned int corner = base + samplesPerSegment * 4 + i * 4;
+			*index++ = corner; *index++ = corner + 1; *index++ = corner + 2;
+			*index++ = corner; *index++ = corner + 2; *index++ = corner + 3;
+		}
+	}
+}
@@ -0,0 +1,378 @@
+/************************************************************************
+     File:        TrackSpline.cpp
+
+     Comment:     The curve through the control points of the track
+
+						Only the segments shaped by points that moved are
+						measured again; the queries are binary searches
+						over what was measured.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <xmmintrin.h>
+
+#include "TrackSpline.H"
+#include "Track.H"
+
+const float TrackSpline::tension = 0.5f;
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+TrackSpline::
+TrackSpline()
+	: built_type(Cardinal), built(false), track_revision(0), built_revision(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * Copy the points, see which moved and measure the segments they shape
+//============================================================================
+bool TrackSpline::
+update(const CTrack& track, Type type)
+//============================================================================
+{
+	if (built && track.revision == track_revision && type == built_type)
+		return false;
+	track_revision = track.revision;
+
+	int npts = (int) track.points.size();
+	bool everything = !built || type != built_type || npts != (int) positions.size();
+	built = true;
+	built_type = type;
+	setBasis(type);
+
+	dirty.assign(npts, everything);
+	positions.resize(npts);
+	orients.resize(npts);
+	for (int i = 0; i < npts; ++i) {
+		const ControlPoint& cp = track.points[i];
+		glm::vec3 pos(cp.pos.x, cp.pos.y, cp.pos.z);
+		glm::vec3 orient(cp.orient.x, cp.orient.y, cp.orient.z);
+		if (!everything && pos == positions[i] && orient == orients[i])
+			continue;
+		positions[i] = pos;
+		orients[i] = orient;
+		// point i shapes the segments that start at i-2 .. i+1 (the
+		// lines only i-1 and i)
+		int first = (type == Linear) ? -1 : -2;
+		int last = (type == Linear) ? 0 : 1;
+		for (int d = first; d <= last; ++d)
+			dirty[((i + d) % npts + npts) % npts] = true;
+	}
+
+	changed_segments.clear();
+	table.resize(npts * samplesPerSegment);
+	for (int i = 0; i < npts; ++i)
+		if (dirty[i]) {
+			measure(i);
+			changed_segments.push_back(i);
+		}
+	if (changed_segments.empty() && !everything)
+		return false;
+
+	// the running total - additions only, the measuring is what costs
+	starts.resize(npts + 1);
+	starts[0] = 0;
+	for (int i = 0; i < npts; ++i)
+		starts[i + 1] = starts[i] + table[i * samplesPerSegment + samplesPerSegment - 1];
+
+	++built_revision;
+	return true;
+}
+
+//****************************************************************************
+//
+// * Chord lengths between evenly spaced points of the segment, summed up
+//============================================================================
+void TrackSpline::
+measure(int segment)
+//============================================================================
+{
+	float* lengths = &table[segment * samplesPerSegment];
+	glm::vec3 last = position((float) segment);
+	lengths[0] = 0;
+	for (int k = 1; k < samplesPerSegment; ++k) {
+		glm::vec3 p = position(segment + (float) k / (samplesPerSegment - 1));
+		lengths[k] = lengths[k - 1] + glm::length(p - last);
+		last = p;
+	}
+}
+
+//============================================================================
+void TrackSpline::
+locate(float u, int& segment, float& t) const
+//============================================================================
+{
+	int n = segments();
+	float wrapped = fmodf(u, (float) n);
+	if (wrapped < 0)
+		wrapped += n;
+	segment = std::min((int) wrapped, n - 1);
+	t = wrapped - segment;
+}
+
+//****************************************************************************
+//
+// * The basis: each type as cubics in t weighing points i-1, i, i+1, i+2
+//============================================================================
+void TrackSpline::
+setBasis(Type type)
+//============================================================================
+{
+	float s = tension;
+	const float linear[4][4] = {
+		{ 0, 0,  0, 0 },
+		{ 0, 0, -1, 1 },
+		{ 0, 0,  1, 0 },
+		{ 0, 0,  0, 0 }
+	};
+	const float cardinal[4][4] = {
+		{ -s,		2 * s,		-s,	0 },
+		{ 2 - s,	s - 3,		0,		1 },
+		{ s - 2,	3 - 2 * s,	s,		0 },
+		{ s,		-s,			0,		0 }
+	};
+	const float bspline[4][4] = {
+		{ -1.0f / 6,	 0.5f,	-0.5f,	1.0f / 6 },
+		{  0.5f,			-1.0f,	 0.0f,	2.0f / 3 },
+		{ -0.5f,			 0.5f,	 0.5f,	1.0f / 6 },
+		{  1.0f / 6,	 0.0f,	 0.0f,	0.0f }
+	};
+	const float (*chosen)[4] = (type == Linear) ? linear : (type == Cardinal) ? cardinal : bspline;
+	memcpy(basis, chosen, sizeof(basis));
+}
+
+//============================================================================
+void TrackSpline::
+weights(float t, float w[4], float dw[4]) const
+//============================================================================
+{
+	for (int k = 0; k < 4; ++k) {
+		const float* c = basis[k];
+		w[k] = ((c[0] * t + c[1]) * t + c[2]) * t + c[3];
+		dw[k] = (3 * c[0] * t + 2 * c[1]) * t + c[2];
+	}
+}
+
+//============================================================================
+glm::vec3 TrackSpline::
+position(float u) const
+//============================================================================
+{
+	int n = segments();
+	if (!n)
+		return glm::vec3(0);
+	int segment;
+	float t;
+	locate(u, segment, t);
+	float w[4], dw[4];
+	weights(t, w, dw);
+
+	glm::vec3 p(0);
+	for (int k = 0; k < 4; ++k)
+		p += w[k] * positions[(segment - 1 + k + n) % n];
+	return p;
+}
+
+//****************************************************************************
+//
+// * Position, direction and the blended orientation, squared up
+//============================================================================
+TrackSpline::Frame TrackSpline::
+frame(float u) const
+//============================================================================
+{
+	Frame f;
+	f.position = glm::vec3(0);
+	f.tangent = glm::vec3(1, 0, 0);
+	f.up = glm::vec3(0, 1, 0);
+	int n = segments();
+	if (!n)
+		return f;
+
+	int segment;
+	float t;
+	locate(u, segment, t);
+	float w[4], dw[4];
+	weights(t, w, dw);
+
+	glm::vec3 velocity(0), orient(0);
+	for (int k = 0; k < 4; ++k) {
+		int i = (segment - 1 + k + n) % n;
+		f.position += w[k] * positions[i];
+		velocity += dw[k] * positions[i];
+		orient += w[k] * orients[i];
+	}
+
+	// points on top of each other stop the curve - look at the next one
+	if (glm::length(velocity) < 1e-6f)
+		velocity = positions[(segment + 1) % n] - positions[segment];
+	if (glm::length(velocity) > 1e-6f)
+		f.tangent = glm::normalize(velocity);
+
+	glm::vec3 up = orient - glm::dot(orient, f.tangent) * f.tangent;
+	if (glm::length(up) < 1e-6f) {
+		// pointing along the track - fall back on the world's up, or any
+		glm::vec3 world = (fabsf(f.tangent.y) < 0.99f) ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0);
+		up = world - glm::dot(world, f.tangent) * f.tangent;
+	}
+	f.up = glm::normalize(up);
+	return f;
+}
+
+//****************************************************************************
+//
+// * u to distance: the segment's start plus its table, read between entries
+//============================================================================
+float TrackSpline::
+distance(float u) const
+//============================================================================
+{
+	int n = segments();
+	if (!n || !built)
+		return 0;
+	int segment;
+	float t;
+	locate(u, segment, t);
+
+	const float* lengths = &table[segment * samplesPerSegment];
+	float x = t * (samplesPerSegment - 1);
+	int k = std::min((int) x, samplesPerSegment - 2);
+	float f = x - k;
+	return starts[segment] + lengths[k] + f * (lengths[k + 1] - lengths[k]);
+}
+
+//****************************************************************************
+//
+// * distance to u: find the segment among the starts, then the entries
+//   of its table around s, and go between them
+//============================================================================
+float TrackSpline::
+parameter(float s) const
+//============================================================================
+{
+	int n = segments();
+	float total = length();
+	if (!n || total <= 0)
+		return 0;
+	s = fmodf(s, total);
+	if (s < 0)
+		s += total;
+
+	// the last start at or before s
+	int segment = (int) (std::upper_bound(starts.begin(), starts.end(), s) - starts.begin()) - 1;
+	segment = std::max(0, std::min(segment, n - 1));
+	float local = s - starts[segment];
+
+	const float* lengths = &table[segment * samplesPerSegment];
+	int k = (int) (std::upper_bound(lengths, lengths + samplesPerSegment, local) - lengths) - 1;
+	k = std::max(0, std::min(k, samplesPerSegment - 2));
+	float span = lengths[k + 1] - lengths[k];
+	float f = (span > 0) ? (local - lengths[k]) / span : 0.0f;
+	f = std::max(0.0f, std::min(f, 1.0f));
+	return segment + (k + f) / (samplesPerSegment - 1);
+}
+
+//============================================================================
+float TrackSpline::
+advance(float u, float ds) const
+//============================================================================
+{
+	return parameter(distance(u) + ds);
+}
+
+//****************************************************************************
+//
+// * Frames along a segment, four u at a time: the weights, the sums over
+//   the four points and the squaring up all go lane by lane in SSE. the
+//   rare lane that degenerates (points on top of each other, orientation
+//   along the track) is done again by frame, which knows what to do
+//============================================================================
+void TrackSpline::
+segmentFrames(int segment, int count, Frame* frames) const
+//============================================================================
+{
+	int n = segments();
+	if (!n)
+		return;
+
+	// the four points, each coordinate splatted across the lanes
+	__m128 p[4][3], o[4][3];
+	for (int k = 0; k < 4; ++k) {
+		int i = (segment - 1 + k + n) % n;
+		for (int c = 0; c < 3; ++c) {
+			p[k][c] = _mm_set1_ps(positions[i][c]);
+			o[k][c] = _mm_set1_ps(orients[i][c]);
+		}
+	}
+	const __m128 tiny = _mm_set1_ps(1e-12f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 step = _mm_set1_ps(1.0f / count);
+
+	for (int first = 0; first < count; first += 4) {
+		__m128 t = _mm_mul_ps(_mm_setr_ps((float) first, (float) first + 1, (float) first + 2, (float) first + 3), step);
+
+		__m128 pos[3], vel[3], orient[3];
+		for (int c = 0; c < 3; ++c)
+			pos[c] = vel[c] = orient[c] = _mm_setzero_ps();
+		for (int k = 0; k < 4; ++k) {
+			const float* b = basis[k];
+			__m128 c0 = _mm_set1_ps(b[0]), c1 = _mm_set1_ps(b[1]), c2 = _mm_set1_ps(b[2]), c3 = _mm_set1_ps(b[3]);
+			__m128 w = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(c0, t), c1), t), c2), t), c3);
+			__m128 dw = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(3), c0), t),
+				_mm_mul_ps(_mm_set1_ps(2), c1)), t), c2);
+			for (int c = 0; c < 3; ++c) {
+				pos[c] = _mm_add_ps(pos[c], _mm_mul_ps(w, p[k][c]));
+				vel[c] = _mm_add_ps(vel[c], _mm_mul_ps(dw, p[k][c]));
+				orient[c] = _mm_add_ps(orient[c], _mm_mul_ps(w, o[k][c]));
+			}
+		}
+
+		// tangent = vel / |vel|
+		__m128 speed2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vel[0], vel[0]), _mm_mul_ps(vel[1], vel[1])), _mm_mul_ps(vel[2], vel[2]));
+		__m128 inverse = _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(speed2, tiny)));
+		__m128 tangent[3];
+		for (int c = 0; c < 3; ++c)
+			tangent[c] = _mm_mul_ps(vel[c], inverse);
+
+		// up = the orientation less its part along the tangent, unit length
+		__m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(orient[0], tangent[0]), _mm_mul_ps(orient[1], tangent[1])),
+			_mm_mul_ps(orient[2], tangent[2]));
+		__m128 up[3];
+		for (int c = 0; c < 3; ++c)
+			up[c] = _mm_sub_ps(orient[c], _mm_mul_ps(along, tangent[c]));
+		__m128 up2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(up[0], up[0]), _mm_mul_ps(up[1], up[1])), _mm_mul_ps(up[2], up[2]));
+		inverse = _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(up2, tiny)));
+		for (int c = 0; c < 3; ++c)
+			up[c] = _mm_mul_ps(up[c], inverse);
+
+		float out[11][4];
+		for (int c = 0; c < 3; ++c) {
+			_mm_storeu_ps(out[c], pos[c]);
+			_mm_storeu_ps(out[3 + c], tangent[c]);
+			_mm_storeu_ps(out[6 + c], up[c]);
+		}
+		_mm_storeu_ps(out[9], speed2);
+		_mm_storeu_ps(out[10], up2);
+
+		for (int lane = 0; lane < 4 && first + lane < count; ++lane) {
+			Frame& f = frames[first + lane];
+			if (out[9][lane] < 1e-12f || out[10][lane] < 1e-12f) {
+				f = frame(segment + (float) (first + lane) / count);
+				continue;
+			}
+			f.position = glm::vec3(out[0][lane], out[1][lane], out[2][lane]);
+			f.tangent = glm::vec3(out[3][lane], out[4][lane], out[5][lane]);
+			f.up = glm::vec3(out[6][lane], out[7][lane], out[8][lane]);
+		}
+	}
+}
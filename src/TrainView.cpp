@@ -26,10 +26,14 @@
 
 #include <iostream>
 #include<string>
+#include <algorithm>
+#include <ctime>
 #include <Fl/fl.h>
 
 // we will need OpenGL, and OpenGL needs windows.h
 #include <windows.h>
+// fl_xid - the window the render thread draws into
+#include <Fl/x.H>
 //#include "GL/gl.h"
 #include <glad/glad.h>
 #include <glm/glm.hpp>
@@ -47,6 +51,17 @@
 #endif
 
 
+// set from the command line (--core) before the window is made
+bool TrainView::core_profile = false;
+// and --render-thread
+bool TrainView::render_thread_mode = false;
+// and --loopback-audio
+bool TrainView::loopback_audio = false;
+
+bool TrainView::check_allocations = false;
+int TrainView::check_frames = 0;
+int TrainView::allocating_frames = 0;
+
 //************************************************************************
 //
 // * Constructor to set up the GL window
@@ -56,9 +71,34 @@ TrainView(int x, int y, int w, int h, const char* l)
 	: Fl_Gl_Window(x,y,w,h,l)
 //========================================================================
 {
-	mode( FL_RGB|FL_ALPHA|FL_DOUBLE | FL_STENCIL );
+	int gl_mode = FL_RGB|FL_ALPHA|FL_DOUBLE | FL_STENCIL;
+	if (core_profile)
+		gl_mode |= FL_OPENGL3;
+	mode( gl_mode );
 
 	resetArcball();
+
+	splash_sound = audio.load("Audios/bounce.wav");
+	audio.start(loopback_audio);
+}
+
+//************************************************************************
+//
+// * the context goes with the window, so the render thread has to let go
+//   of it first
+//========================================================================
+TrainView::
+~TrainView()
+//========================================================================
+{
+	stopRenderThread();
+}
+
+void TrainView::
+hide()
+{
+	stopRenderThread();
+	Fl_Gl_Window::hide();
 }
 
 //************************************************************************
@@ -103,7 +143,9 @@ int TrainView::handle(int event)
 			// if the left button be pushed is left mouse button
 			if (last_push == FL_LEFT_MOUSE  ) {
 				doPick();
-				//addDrop();
+				// missed the control points - splash the water instead
+				if (selectedCube < 0)
+					addDrop();
 				damage(1);
 				return 1;
 			};
@@ -122,8 +164,10 @@ int TrainView::handle(int event)
 			if ((last_push == FL_LEFT_MOUSE) && (selectedCube >= 0)) {
 				ControlPoint* cp = &m_pTrack->points[selectedCube];
 
-				double r1x, r1y, r1z, r2x, r2y, r2z;
-				getMouseLine(r1x, r1y, r1z, r2x, r2y, r2z);
+				glm::vec3 origin, dir;
+				getMouseRay(origin, dir);
+				double r1x = origin.x, r1y = origin.y, r1z = origin.z;
+				double r2x = origin.x + dir.x, r2y = origin.y + dir.y, r2z = origin.z + dir.z;
 
 				double rx, ry, rz;
 				mousePoleGo(r1x, r1y, r1z, r2x, r2y, r2z, 
@@ -136,8 +180,12 @@ int TrainView::handle(int event)
 				cp->pos.x = (float) rx;
 				cp->pos.y = (float) ry;
 				cp->pos.z = (float) rz;
+				m_pTrack->touch();
 				damage(1);
 			}
+			// dragging over the water leaves a trail of drops
+			else if ((last_push == FL_LEFT_MOUSE) && addDrop())
+				damage(1);
 			break;
 
 		// in order to get keyboard events, we need to accept focus
@@ -168,72 +216,123 @@ int TrainView::handle(int event)
 
 					return 1;
 				};
+				if (k == 's') {
+					// how much the state cache saved on the last frame,
+					// how full the stream buffer is, and what it allocated
+					StateCache::instance().printStats();
+					stream.printStats();
+					AllocationTracker::print("Last frame", frame_allocations);
+					return 1;
+				}
 				break;
 	}
 
 	return Fl_Gl_Window::handle(event);
 }
 
-void TrainView::addDrop() {
-	this->drop_point = glm::vec2(0.5, 0.5);
+// the most drops drop.frag takes in one pass (its MAX_DROPS)
+static const int maxDropsPerPass = 16;
+// and the most we keep for one frame - a fast drag can't pile up work
+static const size_t maxPendingDrops = 4 * maxDropsPerPass;
+// size of the ripple simulation textures
+static const int rippleSize = 400;
+// the vertex buffer binding of the control points' instance data
+static const GLuint controlPointInstances = 2;
+// and the vessels', and the wakes'
+static const GLuint vesselInstances = 3;
+static const GLuint wakeInstances = 4;
+// how far the hulls lift (and sink) the water each step, per unit of
+// speed, in water.obj's units - the ripple simulation's height is scaled
+// by WaterSurface::rippleHeight when it is drawn
+static const float wakeLift = 0.0004f;
+// room in the stream buffer for one frame (it grows if that isn't enough)
+static const GLsizeiptr streamRegionSize = 1 << 20;
+// frames let go by after something that allocates (the buffers growing
+// to what the frames need) before they have to stop
+static const int allocationSettleFrames = 60;
+// the rate recordings play at (the frames are retimed to it)
+static const int captureRate = 60;
+// how many times the height maps may be halved to fit the GPU budget
+static const int maxWaveReduction = 3;
+// the uniform block binding of the water's lights
+static const GLuint waterLightingBinding = 1;
+
+// water_lighting in water.frag and heightMap.frag, laid out std140 (a
+// vec3 or a struct takes 16 bytes)
+struct WaterLighting {
+	glm::vec4	view_pos;			// xyz
+	glm::vec4	shininess;			// x - the material
+	glm::vec4	direction, ambient, diffuse, specular;	// the directional light
+	struct PointLight {
+		glm::vec3	position;
+		float			constant;
+		float			linear, quadratic, padding[2];
+		glm::vec4	ambient, diffuse, specular;
+	}				point_lights[4];
+};
+static_assert(sizeof(WaterLighting) == 416, "WaterLighting must match the std140 block");
+
+// a new name for each recording, from when it started
+static std::string captureName()
+{
+	char name[64];
+	time_t now = ::time(nullptr);
+	strftime(name, sizeof(name), "capture_%Y%m%d_%H%M%S", localtime(&now));
+	return name;
 }
 
-unsigned int loadCubemap(vector<const GLchar*> faces)
+//************************************************************************
+//
+// * Hit the displaced water with the mouse ray and queue a drop there
+//   the drops are splashed into the ripple simulation on the next draw
+//========================================================================
+bool TrainView::
+addDrop()
+//========================================================================
 {
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+	if (pending_drops.size() >= maxPendingDrops)
+		return false;
 
-	int width, height, nrChannels;
-	for (unsigned int i = 0; i < faces.size(); i++)
-	{
-		cv::Mat img;
-		img = cv::imread(faces[i], cv::IMREAD_COLOR);
+	glm::vec3 origin, dir;
+	getMouseRay(origin, dir);
 
-		 width=img.cols;
-		 height=img.rows;
-		if (!img.empty())
-		{
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB ,width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, img.data);
-		}
-		else
-		{
-			std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-		}
-		img.release();
-	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	// the water looks like what was drawn last
+	updateWater();
+
+	glm::vec3 hit;
+	glm::vec2 uv;
+	if (!water_surface.intersect(origin, dir, hit, uv))
+		return false;
 
-	return textureID;
+	pending_drops.push_back(uv);
+
+	// no two splashes quite alike
+	splash_seed = splash_seed * 1664525u + 1013904223u;
+	float vary = (splash_seed >> 8) / 16777216.0f;
+	audio.play(splash_sound, hit, 0.8f + 0.2f * vary, 0.9f + 0.2f * vary);
+	return true;
 }
 
-unsigned int loadTexture(const GLchar* tex)
+//************************************************************************
+//
+// * Mirror the displacement the water is drawn with (for hitting it, and
+//   floating the vessels on it)
+//========================================================================
+void TrainView::
+updateWater()
+//========================================================================
 {
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_2D, textureID);
-	cv::Mat img;
-	img = cv::imread(tex, cv::IMREAD_COLOR);
-	int width = img.cols;
-	int height = img.rows;
-
-	glGenerateMipmap(GL_TEXTURE_2D);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	if (img.type() == CV_8UC3)
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, img.cols, img.rows, 0, GL_BGR, GL_UNSIGNED_BYTE, img.data);
-	else if (img.type() == CV_8UC4)
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, img.cols, img.rows, 0, GL_BGRA, GL_UNSIGNED_BYTE, img.data);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	img.release();
-	return textureID;
+	water_surface.place(this->source_pos, 100.0f);
+	water_surface.setWave((WaterSurface::Wave) tw->waveBrowser->value(),
+		(float) tw->amplitude->value(), (float) tw->waveLength->value(),
+		(float) tw->speed->value(), this->time, count_height_map);
+
+	// the newest ripples the render thread has read back
+	std::lock_guard<std::mutex> lock(ripple_mutex);
+	if (ripple_fresh) {
+		water_surface.setRipples(ripple_ready, rippleSize);
+		ripple_fresh = false;
+	}
 }
 
 void readObj(
@@ -347,12 +446,338 @@ void readObj(
 		normals.push_back(glm::vec3(0, 1, 0));
 	}
 }
+//************************************************************************
+//
+// * FLTK asks for a frame on this thread (the usual mode, and the first
+//   frame of the render thread's, which loads everything)
+//========================================================================
+void TrainView::draw()
+{
+	frame_start = AllocationTracker::thread();
+	captureFrame(frame);
+	pending_drops.clear();
+	track_mesh.clearPending();
+	render();
+	countAllocations();
+}
+
+//************************************************************************
+//
+// * with the render thread, the window doesn't draw when FLTK flushes
+//   it: it posts the state of the frame and goes back to the events.
+//   the first frame is still drawn here, the usual way (make_current,
+//   draw, swap), so all of the loading happens with the context on this
+//   thread - then the context is handed over
+//========================================================================
+void TrainView::
+flush()
+//========================================================================
+{
+	if (!render_thread_mode) {
+		Fl_Gl_Window::flush();
+		return;
+	}
+	if (!render_thread.joinable()) {
+		Fl_Gl_Window::flush();
+		startRenderThread();
+		return;
+	}
+	postFrame();
+}
+
+//************************************************************************
+//
+// * Take everything the next frame needs from the widgets, the camera
+//   and the track (UI thread). the drops waiting are copied, the caller
+//   clears them once the frame is sure to be drawn
+//========================================================================
+void TrainView::
+captureFrame(FrameState& state)
+//========================================================================
+{
+	// the track and the vessels first - the train camera rides one
+	updateTrack();
+	updateWater();
+	fleet.place(spline, m_pTrack->trainU, (int) tw->vessels->value(), water_surface);
+	computeCamera();
+	state.width = w();
+	state.height = h();
+	state.view = view_matrix;
+	state.projection = projection_matrix;
+	state.top_cam = tw->topCam->value() != 0;
+	state.train_cam = tw->trainCam->value() != 0;
+
+	state.wave = tw->waveBrowser->value();
+	state.amplitude = (float) tw->amplitude->value();
+	state.wave_length = (float) tw->waveLength->value();
+	state.speed = (float) tw->speed->value();
+	state.roughness = (float) tw->roughness->value();
+	state.probe_faces = (int) tw->probeFaces->value();
+	state.scene_budget = (float) tw->sceneBudget->value();
+	state.prepass = tw->prepass->value() != 0;
+	state.bloom = tw->bloom->value() != 0;
+	state.tonemap = tw->tonemap->value() != 0;
+	state.pixelate = tw->pixel->value() != 0;
+	state.fxaa = tw->fxaa->value() != 0;
+	state.record = tw->record->value() != 0;
+	state.record_y4m = tw->recordY4m->value() != 0;
+	state.gpu_budget = (size_t) tw->gpuBudget->value() * 1024 * 1024;
+
+	state.time = this->time;
+	state.height_map = count_height_map;
+
+	// the control points as drawControlPoints' instance data
+	size_t npts = m_pTrack->points.size();
+	state.control_points.resize(npts * 7);
+	for (size_t i = 0; i < npts; ++i) {
+		const ControlPoint& cp = m_pTrack->points[i];
+		GLfloat* inst = &state.control_points[i * 7];
+		inst[0] = cp.pos.x;
+		inst[1] = cp.pos.y;
+		inst[2] = cp.pos.z;
+		inst[3] = cp.orient.x;
+		inst[4] = cp.orient.y;
+		inst[5] = cp.orient.z;
+		inst[6] = (((int) i) == selectedCube) ? 1.0f : 0.0f;
+	}
+
+	state.drops = pending_drops;
+
+	// the parts of the track that changed since the last frame posted
+	state.track_segments = track_mesh.segments();
+	state.track_changed = track_mesh.pendingSegments();
+	track_mesh.pendingVertices(state.track_vertices);
+
+	// the vessels push the water as hard as they go (not at all, stopped)
+	fleet.instances(state.vessels);
+	float strength = tw->runButton->value() ?
+		wakeLift / WaterSurface::rippleHeight * (float) tw->speed->value() : 0.0f;
+	fleet.wakes(water_surface, strength, state.wakes);
+	state.wake_size = glm::vec2(Fleet::length, Fleet::beam) * (0.5f * water_surface.rippleScale());
+
+	// the splashes are heard from the camera
+	glm::mat4 camera = glm::inverse(view_matrix);
+	audio.setListener(glm::vec3(camera[3]), -glm::vec3(camera[2]), glm::vec3(camera[1]));
+
+	// what the renderer holds, when that changes
+	GpuResources& gpu = GpuResources::instance();
+	if (gpu.revision() != gpu_revision) {
+		gpu_revision = gpu.revision();
+		gpu.summary(gpu_summary, sizeof(gpu_summary));
+		tw->gpuMemory->label(gpu_summary);
+		tw->gpuMemory->redraw();
+	}
+}
+
+//************************************************************************
+//
+// * Hand the next frame to the render thread (UI thread). if it is still
+//   busy with the last two, this one is posted again when it shows one -
+//   so the newest state always gets drawn, but never more than the thread
+//   can keep up with
+//========================================================================
+void TrainView::
+postFrame()
+//========================================================================
+{
+	FrameState next;
+	captureFrame(next);
+	if (!frame_queue.push(std::move(next))) {
+		// the drops stay pending for that one
+		frame_missed = true;
+		return;
+	}
+	pending_drops.clear();
+	track_mesh.clearPending();
+	frame_missed = false;
+
+	// the queue needs no lock; this only makes sure the thread can't
+	// miss the wake up between looking at the queue and going to sleep
+	{
+		std::lock_guard<std::mutex> lock(render_mutex);
+	}
+	render_wake.notify_one();
+}
+
+//************************************************************************
+//
+// * Give the context (current on the UI thread after the first frame) to
+//   a thread of its own
+//========================================================================
+void TrainView::
+startRenderThread()
+//========================================================================
+{
+	wglMakeCurrent(NULL, NULL);
+	rendering = true;
+	render_thread = std::thread(&TrainView::renderLoop, this);
+}
+
+void TrainView::
+stopRenderThread()
+{
+	if (!render_thread.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(render_mutex);
+		rendering = false;
+	}
+	render_wake.notify_one();
+	render_thread.join();
+	// the context is free again - the next flush starts over on this thread
+	FrameState dropped;
+	while (frame_queue.pop(dropped))
+		;
+}
+
+//************************************************************************
+//
+// * The render thread: sleep until a frame is posted, draw the newest
+//   one (with the drops of any it skipped), show it, and tell the UI
+//========================================================================
+void TrainView::
+renderLoop()
+//========================================================================
+{
+	HWND window = fl_xid(this);
+	HDC dc = GetDC(window);
+	wglMakeCurrent(dc, (HGLRC) context());
+
+	FrameState next;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(render_mutex);
+			render_wake.wait(lock, [this]() { return !rendering || !frame_queue.empty(); });
+		}
+		if (!rendering)
+			break;
+
+		bool first = true;
+		while (frame_queue.pop(next)) {
+			if (!first) {
+				next.drops.insert(next.drops.begin(), frame.drops.begin(), frame.drops.end());
+				// the skipped frame's blocks first, so the newer ones win
+				// (a new number of segments changes all of them anyway)
+				if (next.track_segments == frame.track_segments) {
+					next.track_changed.insert(next.track_changed.begin(), frame.track_changed.begin(), frame.track_changed.end());
+					next.track_vertices.insert(next.track_vertices.begin(), frame.track_vertices.begin(), frame.track_vertices.end());
+				}
+			}
+			std::swap(frame, next);
+			first = false;
+		}
+
+		frame_start = AllocationTracker::thread();
+		render();
+		countAllocations();
+		SwapBuffers(dc);
+		Fl::awake(frameShown, this);
+	}
+
+	wglMakeCurrent(NULL, NULL);
+	ReleaseDC(window, dc);
+}
+
+//************************************************************************
+//
+// * a frame is on the screen (UI thread, from Fl::awake) - room in the
+//   queue again for one that didn't fit
+//========================================================================
+void TrainView::
+frameShown(void* data)
+//========================================================================
+{
+	TrainView* view = (TrainView*) data;
+	if (view->frame_missed && view->render_thread.joinable())
+		view->postFrame();
+}
+
+//************************************************************************
+//
+// * a settled frame allocates nothing: everything it needs was made
+//   while loading or is reused from the frame before (the draw list's
+//   arena, the stream buffer, the frame state's vectors)
+//========================================================================
+void TrainView::
+countAllocations()
+//========================================================================
+{
+	frame_allocations = AllocationTracker::thread() - frame_start;
+	if (settled_frames < allocationSettleFrames) {
+		++settled_frames;
+		return;
+	}
+	if (!check_allocations)
+		return;
+	if (frame_allocations.allocations) {
+		++allocating_frames;
+		AllocationTracker::print("A settled frame allocated", frame_allocations);
+	}
+	// once, on whichever thread draws - the window closes on the UI's
+	if (++checked_frames == check_frames)
+		Fl::awake(checkDone, this);
+}
+
+//************************************************************************
+//
+// * the frames asked for have been checked: close the window, which
+//   ends Fl::run (main says how it went)
+//========================================================================
+void TrainView::
+checkDone(void* data)
+//========================================================================
+{
+	TrainView* view = (TrainView*) data;
+	printf("%d settled frames checked, %d allocated\n", view->checked_frames, allocating_frames);
+	view->hide();
+	view->tw->hide();
+}
+
+//************************************************************************
+//
+// * the height maps are all that can get smaller without something
+//   missing: each time the total is over the budget they lose their top
+//   level (a quarter of them), up to maxWaveReduction times. they stay
+//   that way until the program starts again
+//========================================================================
+void TrainView::
+enforceGpuBudget()
+//========================================================================
+{
+	GpuResources& gpu = GpuResources::instance();
+	gpu.setBudget(frame.gpu_budget);
+	while (gpu.overBudget() && wave_reduction < maxWaveReduction) {
+		// identical frames share a texture: it is reduced once, and every
+		// frame that had it gets the new one (and isn't reduced again)
+		bool reduced[200] = { false };
+		for (int i = 0; i < 200; i++) {
+			GLuint old = height_map_tex[i];
+			if (!old || reduced[i])
+				continue;
+			GLuint smaller = AssetManager::instance().reduce(old);
+			for (int j = i; j < 200; j++)
+				if (height_map_tex[j] == old && !reduced[j]) {
+					height_map_tex[j] = smaller;
+					reduced[j] = true;
+				}
+		}
+		++wave_reduction;
+		settled_frames = 0;
+		printf("Over the GPU budget by %.1f MB: the waves are at 1/%d resolution\n",
+			gpu.overBudget() / (1024.0 * 1024.0), 1 << wave_reduction);
+	}
+}
+
 //************************************************************************
 //
 // * this is the code that actually draws the window
 //   it puts a lot of the work into other routines to simplify things
+//   it only reads this->frame, so it runs on whichever thread has the
+//   context
+//========================================================================
+void TrainView::
+render()
 //========================================================================
-void TrainView::draw()
 {
 
 	//*********************************************************************
@@ -360,14 +785,25 @@ void TrainView::draw()
 	// * Set up basic opengl informaiton
 	//
 	//**********************************************************************
-	//initialized gladk
-	if (gladLoadGL())
+	//initialized gladk (it allocates, so only the once)
+	if (!gl_loaded)
+		gl_loaded = gladLoadGL() != 0;
+	if (gl_loaded)
 	{
 		//initiailize VAO, VBO, Shader...
 		if (!this->drop)
 		{
 			this->drop=new Shader( "src/shaders/drop.vert", nullptr, nullptr, nullptr, "src/shaders/drop.frag");
-			ripple_tex = loadTexture("Images/ripple.jpg");
+			// the ripple simulation keeps height in r and velocity in g, 
+			// both signed - so it needs a float texture that starts flat
+			std::vector<GLfloat> still_water(rippleSize * rippleSize * 4, 0.0f);
+			glGenTextures(1, &ripple_tex);
+			glBindTexture(GL_TEXTURE_2D, ripple_tex);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, rippleSize, rippleSize, 0, GL_RGBA, GL_FLOAT, &still_water[0]);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 			GLfloat quadVertice[] = {
 				-1.0f,1.0f,0.0f,
 				-1.0f,-1.0f,0.0f,
@@ -387,7 +823,7 @@ void TrainView::draw()
 
 			glGenTextures(1, &empty_textureColorbuffer);
 			glBindTexture(GL_TEXTURE_2D, empty_textureColorbuffer);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 400,400, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, rippleSize, rippleSize, 0, GL_RGBA, GL_FLOAT, NULL);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, empty_textureColorbuffer, 0);
@@ -399,23 +835,33 @@ void TrainView::draw()
 			
 			glGenRenderbuffers(1, &rbo);
 			glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, 400, 400);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, rippleSize, rippleSize);
 			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
 
 			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 				std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
 			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+			GpuResources& resources = GpuResources::instance();
+			resources.texture(ripple_tex, "ripples", "height and velocity", GL_RGBA16F, rippleSize, rippleSize);
+			resources.buffer(quadVBO, "ripples", "quad", sizeof(quadVertice));
+			resources.framebuffer(FFrameBuffer, "ripples", "step");
+			resources.texture(empty_textureColorbuffer, "ripples", "step", GL_RGBA16F, rippleSize, rippleSize);
+			resources.renderbuffer(rbo, "ripples", "depth", GL_DEPTH24_STENCIL8, rippleSize, rippleSize);
+
+			// the heights come back for water_surface; until they do, it is flat
+			ripple_readback.init(rippleSize, rippleSize, "ripples");
+			ripple_back.assign(rippleSize * rippleSize, 0.0f);
+			ripple_ready.assign(rippleSize * rippleSize, 0.0f);
+			std::vector<float> still(rippleSize * rippleSize, 0.0f);
+			water_surface.setRipples(still, rippleSize);
 			
 		}
-		if (!this->update)
-		{
-			this->drop = new Shader( "src/shaders/drop.vert", nullptr, nullptr, nullptr,  "src/shaders/drop.frag");
-		}
-		if (!this->frame_buffer)
+		if (!this->screen_quadVAO)
 		{
-			this->frame_buffer = new Shader( "src/shaders/framebuffer.vert", nullptr, nullptr, nullptr,  "src/shaders/framebuffer.frag");
-
-			float quadVertices[] = { 
+			// two triangles over the screen (position, texture coordinate)
+			// for the post-processing passes
+			float screenVertices[] = {
 			  -1.0f,  1.0f,  0.0f, 1.0f,
 			  -1.0f, -1.0f,  0.0f, 0.0f,
 			   1.0f, -1.0f,  1.0f, 0.0f,
@@ -424,49 +870,6 @@ void TrainView::draw()
 			   1.0f, -1.0f,  1.0f, 0.0f,
 			   1.0f,  1.0f,  1.0f, 1.0f
 			};
-	
-			glGenVertexArrays(1, &frameBuffer_quadVAO);
-			glGenBuffers(1, &frameBuffer_quadVBO);
-			glBindVertexArray(frameBuffer_quadVAO);
-			glBindBuffer(GL_ARRAY_BUFFER, frameBuffer_quadVBO);
-			glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
-			glEnableVertexAttribArray(0);
-			glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
-			glEnableVertexAttribArray(1);
-			glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
-			// framebuffer configuration
-			glGenFramebuffers(1, &frameBuffer_framebuffer);
-			glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer_framebuffer);
-
-			glGenTextures(1, &frameBuffer_textureColorbuffer);
-			glBindTexture(GL_TEXTURE_2D, frameBuffer_textureColorbuffer);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w(), h(), 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, frameBuffer_textureColorbuffer, 0);
-
-			glGenRenderbuffers(1, &frameBuffer_rbo);
-			glBindRenderbuffer(GL_RENDERBUFFER, frameBuffer_rbo);
-			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w(), h()); 
-			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, frameBuffer_rbo); 
-		
-			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-				std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
-			glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		}
-		if (!this->screen)
-		{
-			this->screen = new Shader( "src/shaders/framebuffer_screen.vert", nullptr, nullptr, nullptr, "src/shaders/framebuffer_screen.frag");
-			float screenVertices[] = {
-			  -1.0f,  1.0f,  0.0f,
-			  1.0f, -1.0f, -1.0f,
-			  0.0f, 0.0f, 1.0f,
-			  -1.0f,  1.0f, 0.0f,
-			  -1.0f,  1.0f,  0.0f,
-			  1.0f, 1.0f, -1.0f,
-			  1.0f, 0.0f, 1.0f,
-			  1.0f, 1.0f, 1.0f
-			};
 			glGenVertexArrays(1, &screen_quadVAO);
 			glGenBuffers(1, &screen_quadVBO);
 			glBindVertexArray(screen_quadVAO);
@@ -477,52 +880,53 @@ void TrainView::draw()
 			glEnableVertexAttribArray(1);
 			glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
 
-			screen->Use();
-			glUniform1i(glGetUniformLocation(screen->Program, "screenTexture"), 0);
-
+			// the scene is kept in floating point, so the highlights can
+			// go past 1 (for the bloom and the tone mapping)
 			glGenFramebuffers(1, &screen_framebuffer);
 			glBindFramebuffer(GL_FRAMEBUFFER, screen_framebuffer);
 
 			glGenTextures(1, &screen_textureColorbuffer);
 			glBindTexture(GL_TEXTURE_2D, screen_textureColorbuffer);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w(), h(), 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, frame.width, frame.height, 0, GL_RGBA, GL_FLOAT, NULL);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, screen_textureColorbuffer, 0);
 
 			glGenRenderbuffers(1, &screen_rbo);
 			glBindRenderbuffer(GL_RENDERBUFFER, screen_rbo);
-			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w(), h()); // a single renderbuffer object for both a depth AND stencil buffer.
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, frame.width, frame.height); // a single renderbuffer object for both a depth AND stencil buffer.
 			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, screen_rbo); // now actually attach it
 			// now that we actually created the framebuffer and added all attachments we want to check if it is actually complete now
 			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 				std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
 			glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		
+
+			GpuResources& resources = GpuResources::instance();
+			resources.buffer(screen_quadVBO, "scene", "screen quad", sizeof(screenVertices));
+			resources.framebuffer(screen_framebuffer, "scene", "scene");
+			resources.texture(screen_textureColorbuffer, "scene", "colour", GL_RGBA16F, frame.width, frame.height);
+			resources.renderbuffer(screen_rbo, "scene", "depth", GL_DEPTH24_STENCIL8, frame.width, frame.height);
 		}
 		if (!this->water)
 		{
 			this->water = new Shader( "src/shaders/water.vert", nullptr, nullptr, nullptr,  "src/shaders/water.frag");
+			this->water_depth = new Shader( "src/shaders/water.vert", nullptr, nullptr, nullptr,  "src/shaders/depth_only.frag");
 		}
 		if (!this->height_map)
 		{
 			this->height_map = new Shader( "src/shaders/heightMap.vert", nullptr, nullptr, nullptr,  "src/shaders/heightMap.frag");
+			this->height_map_depth = new Shader( "src/shaders/heightMap.vert", nullptr, nullptr, nullptr,  "src/shaders/depth_only.frag");
 			for (int i = 0; i < 200; i++)
 			{
-				std::string str = "Images/waves/";
-				if (i < 10)
-				{
-					str += ("00" + std::to_string(i) + ".png");
-				}
-				else if (i < 100)
-				{
-					str += ("0" + std::to_string(i) + ".png");
-				}
-				else
-				{
-					str += (std::to_string(i) + ".png");
-				}
-				this->height_map_tex[i] = loadTexture(str.c_str());
+				char path[32];
+				snprintf(path, sizeof(path), "Images/waves/%03d.png", i);
+				// keep a small copy for hitting the water with the mouse
+				cv::Mat img = cv::imread(path, cv::IMREAD_COLOR);
+				if (!img.empty())
+					water_surface.addHeightField(img.data, img.cols, img.rows, img.channels(), (int) img.step);
+				// the waves only need one channel - BC4 is an eighth of RGB8
+				this->height_map_tex[i] = AssetManager::instance().acquireTexture(path, TextureImporter::FORMAT_BC4, nullptr, &img);
+				img.release();
 			}
 			
 		}
@@ -577,6 +981,7 @@ void TrainView::draw()
 			glBindVertexArray(skybox_vao);
 			glBindBuffer(GL_ARRAY_BUFFER, skybox_vbo);
 			glBufferData(GL_ARRAY_BUFFER, sizeof(skybox_vertice), &skybox_vertice, GL_STATIC_DRAW);
+			GpuResources::instance().buffer(skybox_vbo, "skybox", "cube", sizeof(skybox_vertice));
 			glEnableVertexAttribArray(0);
 			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 			vector<const GLchar*> skybox_faces = {
@@ -587,7 +992,20 @@ void TrainView::draw()
 			"Images/skybox/back.jpg",
 			"Images/skybox/front.jpg",
 			};
-			this->skybox_cubemap_tex = loadCubemap(skybox_faces);
+			// a baked cubemap (one .dds with every face and level) skips 
+			// decoding the faces altogether
+			if (FILE* baked = fopen("Images/skybox/skybox.dds", "rb")) {
+				fclose(baked);
+				skybox_faces = { "Images/skybox/skybox.dds" };
+			}
+			int skybox_size = 0;
+			this->skybox_cubemap_tex = AssetManager::instance().acquireCubemap(skybox_faces, TextureImporter::FORMAT_BC1, &skybox_size);
+			// sample across the cube edges, so the mips don't show seams
+			glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+			// the glossy reflections of the skybox for the water
+			environment.build(skybox_cubemap_tex, skybox_size, skybox_faces);
+			// and the scene around the water, drawn in as we go
+			probe.init();
 		}
 		if (!this->tile)
 		{
@@ -677,6 +1095,8 @@ void TrainView::draw()
 
 			glBindBuffer(GL_ARRAY_BUFFER,tile_vbo[1]);
 			glBufferData(GL_ARRAY_BUFFER, sizeof(tile_normals), &tile_normals[0], GL_STATIC_DRAW);
+			GpuResources::instance().buffer(tile_vbo[0], "pool", "positions", sizeof(tile_vertice));
+			GpuResources::instance().buffer(tile_vbo[1], "pool", "normals", sizeof(tile_normals));
 			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
 			glEnableVertexAttribArray(1);
 			vector<const GLchar*> tile_faces = {
@@ -687,16 +1107,139 @@ void TrainView::draw()
 			"Images/tile.jpg",
 			"Images/tile.jpg"
 			};
-			this->tile_cubemap_tex = loadCubemap(tile_faces);
+			this->tile_cubemap_tex = AssetManager::instance().acquireCubemap(tile_faces);
 		}
 
-		if (!this->commom_matrices)
-			this->commom_matrices = new UBO();
-		this->commom_matrices->size = 2 * sizeof(glm::mat4);
-		glGenBuffers(1, &this->commom_matrices->ubo);
-		glBindBuffer(GL_UNIFORM_BUFFER, this->commom_matrices->ubo);
-		glBufferData(GL_UNIFORM_BUFFER, this->commom_matrices->size, NULL, GL_STATIC_DRAW);
-		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		if (!this->control_point)
+		{
+			this->control_point = new Shader( "src/shaders/control_point.vert", nullptr, nullptr, nullptr, "src/shaders/control_point.frag");
+
+			std::vector<GLfloat> glyph_positions;
+			std::vector<GLfloat> glyph_normals;
+			ControlPoint::glyphTriangles(glyph_positions, glyph_normals);
+
+			this->control_point_glyph = new VAO;
+			this->control_point_glyph->count = glyph_positions.size() / 3;
+			glGenVertexArrays(1, &this->control_point_glyph->vao);
+			glGenBuffers(2, this->control_point_glyph->vbo);
+			glBindVertexArray(this->control_point_glyph->vao);
+
+			glBindBuffer(GL_ARRAY_BUFFER, this->control_point_glyph->vbo[0]);
+			glBufferData(GL_ARRAY_BUFFER, glyph_positions.size() * sizeof(GLfloat), &glyph_positions[0], GL_STATIC_DRAW);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+			glEnableVertexAttribArray(0);
+
+			glBindBuffer(GL_ARRAY_BUFFER, this->control_point_glyph->vbo[1]);
+			glBufferData(GL_ARRAY_BUFFER, glyph_normals.size() * sizeof(GLfloat), &glyph_normals[0], GL_STATIC_DRAW);
+			GpuResources::instance().buffer(this->control_point_glyph->vbo[0], "control points", "positions", glyph_positions.size() * sizeof(GLfloat));
+			GpuResources::instance().buffer(this->control_point_glyph->vbo[1], "control points", "normals", glyph_normals.size() * sizeof(GLfloat));
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+			glEnableVertexAttribArray(1);
+
+			// instance attributes: position, orientation, selected
+			// their buffer is bound each frame (where in the stream buffer
+			// they went) at controlPointInstances - only the layout is here
+			glVertexAttribFormat(2, 3, GL_FLOAT, GL_FALSE, 0);
+			glVertexAttribFormat(3, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat));
+			glVertexAttribFormat(4, 1, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat));
+			for (GLuint attribute = 2; attribute <= 4; attribute++) {
+				glVertexAttribBinding(attribute, controlPointInstances);
+				glEnableVertexAttribArray(attribute);
+			}
+			glVertexBindingDivisor(controlPointInstances, 1);
+
+			glBindVertexArray(0);
+		}
+
+		if (!this->track)
+		{
+			this->track = new Shader( "src/shaders/track.vert", nullptr, nullptr, nullptr, "src/shaders/track.frag");
+
+			// the buffers are sized by uploadTrack, for the number of segments
+			this->track_vao = new VAO;
+			this->track_vao->element_amount = 0;
+			glGenVertexArrays(1, &this->track_vao->vao);
+			glGenBuffers(1, this->track_vao->vbo);
+			glGenBuffers(1, &this->track_vao->ebo);
+			glBindVertexArray(this->track_vao->vao);
+
+			glBindBuffer(GL_ARRAY_BUFFER, this->track_vao->vbo[0]);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TrackMesh::Vertex), (GLvoid*)offsetof(TrackMesh::Vertex, position));
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TrackMesh::Vertex), (GLvoid*)offsetof(TrackMesh::Vertex, normal));
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(TrackMesh::Vertex), (GLvoid*)offsetof(TrackMesh::Vertex, tie));
+			glEnableVertexAttribArray(2);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->track_vao->ebo);
+
+			glBindVertexArray(0);
+			this->track_segments = 0;
+		}
+
+		if (!this->vessel)
+		{
+			this->vessel = new Shader( "src/shaders/vessel.vert", nullptr, nullptr, nullptr, "src/shaders/control_point.frag");
+
+			std::vector<GLfloat> hull_positions;
+			std::vector<GLfloat> hull_normals;
+			Fleet::hullTriangles(hull_positions, hull_normals);
+
+			this->hull = new VAO;
+			this->hull->count = hull_positions.size() / 3;
+			glGenVertexArrays(1, &this->hull->vao);
+			glGenBuffers(2, this->hull->vbo);
+			glBindVertexArray(this->hull->vao);
+
+			glBindBuffer(GL_ARRAY_BUFFER, this->hull->vbo[0]);
+			glBufferData(GL_ARRAY_BUFFER, hull_positions.size() * sizeof(GLfloat), &hull_positions[0], GL_STATIC_DRAW);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+			glEnableVertexAttribArray(0);
+
+			glBindBuffer(GL_ARRAY_BUFFER, this->hull->vbo[1]);
+			glBufferData(GL_ARRAY_BUFFER, hull_normals.size() * sizeof(GLfloat), &hull_normals[0], GL_STATIC_DRAW);
+			GpuResources::instance().buffer(this->hull->vbo[0], "vessels", "positions", hull_positions.size() * sizeof(GLfloat));
+			GpuResources::instance().buffer(this->hull->vbo[1], "vessels", "normals", hull_normals.size() * sizeof(GLfloat));
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+			glEnableVertexAttribArray(1);
+
+			// instance attributes: position, heading, up - bound each
+			// frame at vesselInstances, like the control points'
+			for (GLuint k = 0; k < 3; k++) {
+				glVertexAttribFormat(2 + k, 3, GL_FLOAT, GL_FALSE, 3 * k * sizeof(GLfloat));
+				glVertexAttribBinding(2 + k, vesselInstances);
+				glEnableVertexAttribArray(2 + k);
+			}
+			glVertexBindingDivisor(vesselInstances, 1);
+
+			glBindVertexArray(0);
+		}
+
+		if (!this->wake)
+		{
+			this->wake = new Shader( "src/shaders/wake.vert", nullptr, nullptr, nullptr, "src/shaders/wake.frag");
+
+			// the simulation's quad for the corners, the footprints per
+			// instance at wakeInstances
+			glGenVertexArrays(1, &this->wake_vao);
+			glBindVertexArray(this->wake_vao);
+			glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+			glEnableVertexAttribArray(0);
+			glVertexAttribFormat(1, 2, GL_FLOAT, GL_FALSE, 0);
+			glVertexAttribFormat(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat));
+			glVertexAttribFormat(3, 1, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat));
+			for (GLuint attribute = 1; attribute <= 3; attribute++) {
+				glVertexAttribBinding(attribute, wakeInstances);
+				glEnableVertexAttribArray(attribute);
+			}
+			glVertexBindingDivisor(wakeInstances, 1);
+
+			glBindVertexArray(0);
+		}
+
+		// the shared matrices and the instances, every frame
+		if (!this->stream.buffer())
+			this->stream.init(streamRegionSize);
 
 		if (!this->plane) {
 			std::vector<glm::vec3> points;
@@ -727,6 +1270,9 @@ void TrainView::draw()
 			// Texture Coordinate attribute
 			glBindBuffer(GL_ARRAY_BUFFER, this->plane->vbo[2]);
 			glBufferData(GL_ARRAY_BUFFER, texcoords.size() * 2 * 4, &texcoords[0], GL_STATIC_DRAW);
+			GpuResources::instance().buffer(this->plane->vbo[0], "water", "positions", points.size() * 3 * 4);
+			GpuResources::instance().buffer(this->plane->vbo[1], "water", "normals", normals.size() * 3 * 4);
+			GpuResources::instance().buffer(this->plane->vbo[2], "water", "texture coordinates", texcoords.size() * 2 * 4);
 			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid*)0);
 			glEnableVertexAttribArray(2);
 
@@ -735,47 +1281,50 @@ void TrainView::draw()
 
 		}
 
-		if (!this->texture)
-			this->texture = new Texture2D( "Images/water_top.jpg");
+		if (!this->texture) {
+			this->texture = new Texture2D( "Images/water_top.jpg", Texture2D::TEXTURE_DEFAULT, TextureImporter::FORMAT_BC1);
+			// that was the last of the images
+			AssetManager::instance().printStats();
+		}
+		enforceGpuBudget();
 
 
-		static int pre_w = w(), pre_h = h();
+		static int pre_w = frame.width, pre_h = frame.height;
 		// Set up the view port
-		glViewport(0, 0, w(), h());
-		if (pre_w != w() || pre_h != h()) {
+		glViewport(0, 0, frame.width, frame.height);
+		if (pre_w != frame.width || pre_h != frame.height) {
 			glBindFramebuffer(GL_FRAMEBUFFER, screen_framebuffer);
 
 			glBindTexture(GL_TEXTURE_2D, screen_textureColorbuffer);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w(), h(), 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, frame.width, frame.height, 0, GL_RGBA, GL_FLOAT, NULL);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, screen_textureColorbuffer, 0);
 
 			glBindRenderbuffer(GL_RENDERBUFFER, screen_rbo);
-			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w(), h()); // use a single renderbuffer object for both a depth AND stencil buffer.
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, frame.width, frame.height); // use a single renderbuffer object for both a depth AND stencil buffer.
+			GpuResources::instance().texture(screen_textureColorbuffer, "scene", "colour", GL_RGBA16F, frame.width, frame.height);
+			GpuResources::instance().renderbuffer(screen_rbo, "scene", "depth", GL_DEPTH24_STENCIL8, frame.width, frame.height);
 			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, screen_rbo); // now actually attach it
 			// now that we actually created the framebuffer and added all attachments we want to check if it is actually complete now
 			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 				std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
 			glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-			////=======================================================
-			// framebuffer configuration
-			glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer_framebuffer);
-			glBindTexture(GL_TEXTURE_2D, frameBuffer_textureColorbuffer);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w(), h(), 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, frameBuffer_textureColorbuffer, 0);
-
-			glBindRenderbuffer(GL_RENDERBUFFER, frameBuffer_rbo);
-			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w(), h()); // use a single renderbuffer object for both a depth AND stencil buffer.
-			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, frameBuffer_rbo); // now actually attach it
-			// now that we actually created the framebuffer and added all attachments we want to check if it is actually complete now
-			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-				std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
-			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			// only again on the next resize
+			pre_w = frame.width;
+			pre_h = frame.height;
+			settled_frames = 0;
 		}
+		// loading and resizing bind with GL directly (as does the 
+		// fixed-function code every frame), so the cache starts over
+		StateCache& state = StateCache::instance();
+		state.invalidate();
+		state.resetStats();
+		draw_list.newFrame();
+		stream.beginFrame();
+		uploadTrack();
+
 		// clear the window, be sure to clear the Z-Buffer too
 		glClearColor(0, 0, .3f, 0);		// background should be blue
 
@@ -783,59 +1332,63 @@ void TrainView::draw()
 		// it for shadows
 		glClearStencil(0);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-		glEnable(GL_DEPTH);
-
-		// Blayne prefers GL_DIFFUSE
-		glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
-
-		// prepare for projection
-		glMatrixMode(GL_PROJECTION);
-		glLoadIdentity();
-		setProjection();		// put the code to set up matrices here
-
-		//######################################################################
-		// TODO: 
-		// you might want to set the lighting up differently. if you do, 
-		// we need to set up the lights AFTER setting up the projection
-		//######################################################################
-		// enable the lighting
-		glEnable(GL_COLOR_MATERIAL);
 		glEnable(GL_DEPTH_TEST);
-		glEnable(GL_LIGHTING);
-		glEnable(GL_LIGHT0);
 
-		// top view only needs one light
-		if (tw->topCam->value()) {
-			glDisable(GL_LIGHT1);
-			glDisable(GL_LIGHT2);
-		}
-		else {
-			glEnable(GL_LIGHT1);
-			glEnable(GL_LIGHT2);
-		}
+		// the core profile has no fixed-function lights or matrix stack -
+		// everything is drawn by shaders through the shared matrices
+		if (!core_profile) {
+			// Blayne prefers GL_DIFFUSE
+			glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
+
+			// prepare for projection
+			glMatrixMode(GL_PROJECTION);
+			glLoadIdentity();
+			setProjection();		// put the code to set up matrices here
+
+			//######################################################################
+			// TODO: 
+			// you might want to set the lighting up differently. if you do, 
+			// we need to set up the lights AFTER setting up the projection
+			//######################################################################
+			// enable the lighting
+			glEnable(GL_COLOR_MATERIAL);
+			glEnable(GL_DEPTH_TEST);
+			glEnable(GL_LIGHTING);
+			glEnable(GL_LIGHT0);
+
+			// top view only needs one light
+			if (frame.top_cam) {
+				glDisable(GL_LIGHT1);
+				glDisable(GL_LIGHT2);
+			}
+			else {
+				glEnable(GL_LIGHT1);
+				glEnable(GL_LIGHT2);
+			}
 
-		//*********************************************************************
-		//
-		// * set the light parameters
-		//
-		//**********************************************************************
-		GLfloat lightPosition1[] = { 0,1,1,0 }; // {50, 200.0, 50, 1.0};
-		GLfloat lightPosition2[] = { 1, 0, 0, 0 };
-		GLfloat lightPosition3[] = { 0, -1, 0, 0 };
-		GLfloat yellowLight[] = { 0.5f, 0.5f, .1f, 1.0 };
-		GLfloat whiteLight[] = { 1.0f, 1.0f, 1.0f, 1.0 };
-		GLfloat blueLight[] = { .1f,.1f,.3f,1.0 };
-		GLfloat grayLight[] = { .3f, .3f, .3f, 1.0 };
-
-		glLightfv(GL_LIGHT0, GL_POSITION, lightPosition1);
-		glLightfv(GL_LIGHT0, GL_DIFFUSE, whiteLight);
-		glLightfv(GL_LIGHT0, GL_AMBIENT, grayLight);
-
-		glLightfv(GL_LIGHT1, GL_POSITION, lightPosition2);
-		glLightfv(GL_LIGHT1, GL_DIFFUSE, yellowLight);
-
-		glLightfv(GL_LIGHT2, GL_POSITION, lightPosition3);
-		glLightfv(GL_LIGHT2, GL_DIFFUSE, blueLight);
+			//*********************************************************************
+			//
+			// * set the light parameters
+			//
+			//**********************************************************************
+			GLfloat lightPosition1[] = { 0,1,1,0 }; // {50, 200.0, 50, 1.0};
+			GLfloat lightPosition2[] = { 1, 0, 0, 0 };
+			GLfloat lightPosition3[] = { 0, -1, 0, 0 };
+			GLfloat yellowLight[] = { 0.5f, 0.5f, .1f, 1.0 };
+			GLfloat whiteLight[] = { 1.0f, 1.0f, 1.0f, 1.0 };
+			GLfloat blueLight[] = { .1f,.1f,.3f,1.0 };
+			GLfloat grayLight[] = { .3f, .3f, .3f, 1.0 };
+
+			glLightfv(GL_LIGHT0, GL_POSITION, lightPosition1);
+			glLightfv(GL_LIGHT0, GL_DIFFUSE, whiteLight);
+			glLightfv(GL_LIGHT0, GL_AMBIENT, grayLight);
+
+			glLightfv(GL_LIGHT1, GL_POSITION, lightPosition2);
+			glLightfv(GL_LIGHT1, GL_DIFFUSE, yellowLight);
+
+			glLightfv(GL_LIGHT2, GL_POSITION, lightPosition3);
+			glLightfv(GL_LIGHT2, GL_DIFFUSE, blueLight);
+		}
 
 		//*********************************************************************
 		// now draw the ground plane
@@ -844,45 +1397,63 @@ void TrainView::draw()
 
 		// setup FBO for ripple texture 
 
-		//std::cout << drop_point.x << " " << drop_point.y << std::endl;
-		//drop buffer
-		glBindFramebuffer(GL_FRAMEBUFFER, FFrameBuffer);
-		glEnable(GL_DEPTH_TEST);
-		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // we're not using the stencil buffer now
+		//drop buffer - splash in the drops queued since the last frame 
+		//(up to maxDropsPerPass at a time), then take one step of the 
+		//ripple simulation. each pass is copied back into ripple_tex
+		state.bindFramebuffer(FFrameBuffer);
+		state.viewport(0, 0, rippleSize, rippleSize);
+		state.setEnabled(GL_DEPTH_TEST, false);
 			drop->Use();
-			glBindVertexArray(quadVAO);
+			state.bindVertexArray(quadVAO);
 			drop->setInt("u_water", 0);
 			glUniform1f(glGetUniformLocation(this->drop->Program, "u_radius"), 0.09f);
 			glUniform1f(glGetUniformLocation(this->drop->Program, "u_strength"), 0.5f);
-			glUniform2f(glGetUniformLocation(this->drop->Program, "u_center"), drop_point.x,drop_point.y);
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, ripple_tex);
-			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-			glBindVertexArray(0);
-
-		glBindFramebuffer(GL_READ_FRAMEBUFFER, FFrameBuffer);
-		glBindTexture(GL_TEXTURE_2D, ripple_tex);
-		glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, 400,400);
+			state.bindTexture(0, GL_TEXTURE_2D, ripple_tex);
+			for (size_t done = 0; ; ) {
+				int count = (int) std::min(frame.drops.size() - done, (size_t) maxDropsPerPass);
+				glUniform1i(glGetUniformLocation(this->drop->Program, "u_drop_count"), count);
+				if (count)
+					glUniform2fv(glGetUniformLocation(this->drop->Program, "u_centers"), count, &frame.drops[done].x);
+				glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+				// no drops means that was the simulation step - the hulls
+				// push it before it is kept
+				if (!count)
+					splashWakes();
+				glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, rippleSize, rippleSize);
+				if (!count)
+					break;
+				done += count;
+			}
+		// hand the last finished read to updateWater, and start this step's
+		if (ripple_readback.collect(&ripple_back[0])) {
+			std::lock_guard<std::mutex> lock(ripple_mutex);
+			ripple_back.swap(ripple_ready);
+			ripple_fresh = true;
+		}
+		ripple_readback.read(ripple_tex);
+		state.viewport(0, 0, frame.width, frame.height);
 
-		glBindFramebuffer(GL_FRAMEBUFFER, 0); // back to default
+		state.bindFramebuffer(0); // back to default
 		glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT);
 
-		 //cleanup
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		glDeleteFramebuffers(1, &FFrameBuffer);
-		drop_point = glm::vec2(0, 0);
-		glUseProgram(0);
+		// bring a few faces of the reflection probe up to date
+		updateProbe();
 
-		//screen framebuffer
-		glBindFramebuffer(GL_FRAMEBUFFER, screen_framebuffer);
-		glEnable(GL_DEPTH_TEST); 
+		//screen framebuffer - the scene goes in the corner of it the
+		//resolution controller picked, and the screen pass scales it up
+		resolution.setBudget(frame.scene_budget);
+		scene_size = resolution.size(frame.width, frame.height);
+		state.bindFramebuffer(screen_framebuffer);
+		state.viewport(0, 0, scene_size.x, scene_size.y);
+		state.setEnabled(GL_DEPTH_TEST, true);
 		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		resolution.begin();
 
 		setupFloor();
-		glDisable(GL_LIGHTING);
+		if (!core_profile)
+			glDisable(GL_LIGHTING);
 		//drawFloor(200, 10);
 
 
@@ -890,208 +1461,76 @@ void TrainView::draw()
 		// now draw the object and we need to do it twice
 		// once for real, and then once for shadows
 		//*********************************************************************
-		glEnable(GL_LIGHTING);
+		// the control points are drawn through the shared matrices, so
+		// fill them in first
+		setUBO();
+
+		if (!core_profile)
+			glEnable(GL_LIGHTING);
 		setupObjects();
 
 		drawStuff();
 
 		// this time drawing is for shadows (except for top view)
-		if (!tw->topCam->value()) {
-			setupShadows();
-			drawStuff(true);
-			unsetupShadows();
+		if (!frame.top_cam) {
+			if (core_profile) {
+				setupShaderShadows();
+				drawStuff(true);
+				unsetupShaderShadows();
+			}
+			else {
+				setupShadows();
+				drawStuff(true);
+				unsetupShadows();
+			}
 		}
+		// the shadow helpers set depth, stencil and blend themselves
+		state.invalidate();
 
-		setUBO();
-		glBindBufferRange(
-			GL_UNIFORM_BUFFER, /*binding point*/0, this->commom_matrices->ubo, 0, this->commom_matrices->size);
-
-		glm::mat4 view;
-		glGetFloatv(GL_MODELVIEW_MATRIX, &view[0][0]);
-		glm::mat4 projection;
-		glGetFloatv(GL_PROJECTION_MATRIX, &projection[0][0]);
-		glm::mat4 inversion = glm::inverse(view);
+		glm::mat4 inversion = glm::inverse(frame.view);
 		glm::vec3 viewerPos(inversion[3][0], inversion[3][1], inversion[3][2]);
-		
-	
-		//skybox
-		glBindVertexArray(0);
-		glDepthFunc(GL_LESS); // set depth function back to default
-		glDisable(GL_CULL_FACE);
-		glm::mat4 skybox_matrix = glm::mat4();
-		skybox_matrix = glm::translate(skybox_matrix, viewerPos);
-		skybox_matrix = glm::scale(skybox_matrix, glm::vec3(600.0f, 600.0f, 600.0f));
-		glDepthFunc(GL_LEQUAL);
-		skybox->Use();
-		//glUniform1f(glGetUniformLocation(skybox->Program, "skybox"), skybox_cubemap_tex);
-		glUniformMatrix4fv(glGetUniformLocation(skybox->Program, "u_projection"), 1, GL_FALSE, &projection[0][0]);
-		glUniformMatrix4fv(glGetUniformLocation(skybox->Program, "u_view"), 1, GL_FALSE, &view[0][0]);
-		glUniformMatrix4fv(glGetUniformLocation(skybox->Program, "s_model"), 1, GL_FALSE, &skybox_matrix[0][0]);
-		glBindVertexArray(skybox_vao);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, skybox_cubemap_tex);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-		glBindVertexArray(0);
-		glDepthFunc(GL_LESS); // set depth function back to default
-
-
-	
-		
-		//tile
-		glBindVertexArray(0);
-		glDepthFunc(GL_LESS); // set depth function back to default
-		glEnable(GL_CULL_FACE);
-		glFrontFace(GL_CW);
-		glCullFace(GL_FRONT);
-		glm::mat4 tile_matrix = glm::mat4();
-		tile_matrix = glm::scale(tile_matrix, glm::vec3(100.0f, 100.0f, 100.0f));
-		glDepthFunc(GL_LEQUAL);
-
-		tile->Use();
-		tile->setInt("tile", 0);
-		tile->setInt("skybox", 1);
-		tile->setInt("heightmap", 2);
-		//glUniform1f(glGetUniformLocation(tile->Program, "tile"), tile_cubemap_tex);
-		//glUniform1f(glGetUniformLocation(skybox->Program, "skybox"), skybox_cubemap_tex);
-		glUniform3f(glGetUniformLocation(tile->Program, "cameraPos"), viewerPos.x,viewerPos.y,viewerPos.z);
-		glUniform1f(glGetUniformLocation(tile->Program, "amplitude"), tw->amplitude->value());
-		glUniformMatrix4fv(glGetUniformLocation(tile->Program, "u_projection"), 1, GL_FALSE, &projection[0][0]);
-		glUniformMatrix4fv(glGetUniformLocation(tile->Program, "u_view"), 1, GL_FALSE, &view[0][0]);
-		glUniformMatrix4fv(glGetUniformLocation(tile->Program, "s_model"), 1, GL_FALSE, &tile_matrix[0][0]);
-		glBindVertexArray(tile_vao);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, tile_cubemap_tex);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, skybox_cubemap_tex);
-		glActiveTexture(GL_TEXTURE2);
-		glBindTexture(GL_TEXTURE_2D, height_map_tex[count_height_map]);
-		glDrawArrays(GL_TRIANGLES, 0,30);
-		glBindVertexArray(0);
-		glDepthFunc(GL_LESS); // set depth function back to default
-		
-
-		
-		
-		//water
-
-		glm::vec3 pointLightPositions[] = {
-		glm::vec3(0.0f,  10.0f,  0.0f),
-		glm::vec3(2.3f, -3.3f, -4.0f),
-		glm::vec3(-4.0f,  2.0f, -12.0f),
-		glm::vec3(0.0f,  0.0f, -3.0f)
-		};
-
-		glm::mat4 model_matrix = glm::mat4();
-		model_matrix = glm::translate(model_matrix, this->source_pos);
-		model_matrix = glm::scale(model_matrix, glm::vec3(100.0f, 100.0f, 100.0f));
-
-		if (tw->waveBrowser->value() == 1) //sin wave
-		{
-			this->water->Use();
-			this->texture->bind(0);
-		
-			glUniform1f(glGetUniformLocation(this->water->Program, "time"), this->time);
-			glUniform1f(glGetUniformLocation(this->water->Program, "speed"), tw->speed->value());
-			glUniform1f(glGetUniformLocation(this->water->Program, "amplitude"), tw->amplitude->value());
-			glUniform1f(glGetUniformLocation(this->water->Program, "waveLength"), tw->waveLength->value());
-
-			GLint viewPosLoc = glGetUniformLocation(this->water->Program, "viewPos");
-			glUniform3f(viewPosLoc, viewerPos.x, viewerPos.y, viewerPos.z);
-			glUniform1f(glGetUniformLocation(this->water->Program, "material.shininess"), 32.0f);
-
-			glUniform3f(glGetUniformLocation(this->water->Program, "dirLight.direction"), -0.2f, -1.0f, -0.3f);
-			glUniform3f(glGetUniformLocation(this->water->Program, "dirLight.ambient"), 0.0f, 0.0f, 0.0f);
-			glUniform3f(glGetUniformLocation(this->water->Program, "dirLight.diffuse"), 0.1f, 0.1f, 0.1f);
-			glUniform3f(glGetUniformLocation(this->water->Program, "dirLight.specular"), 0.5f, 0.5f, 0.5f);
-
-			glUniform3f(glGetUniformLocation(this->water->Program, "pointLights[0].position"), pointLightPositions[0].x, pointLightPositions[0].y, pointLightPositions[0].z);
-			glUniform3f(glGetUniformLocation(this->water->Program, "pointLights[0].ambient"), 0.0f, 0.0f, 0.0f);
-			glUniform3f(glGetUniformLocation(this->water->Program, "pointLights[0].diff"), 0.8f, 0.8f, 0.8f);
-			glUniform3f(glGetUniformLocation(this->water->Program, "pointLights[0].specular"), 1.0f, 1.0f, 1.0f);
-			glUniform1f(glGetUniformLocation(this->water->Program, "pointLights[0].constant"), 1.0f);
-			glUniform1f(glGetUniformLocation(this->water->Program, "pointLights[0].linear"), 0.09);
-			glUniform1f(glGetUniformLocation(this->water->Program, "pointLights[0].quadratic"), 0.032);
-
-			glUniformMatrix4fv(
-				glGetUniformLocation(this->water->Program, "u_model"), 1, GL_FALSE, &model_matrix[0][0]);
-
-		}
-		else if (tw->waveBrowser->value() == 2) //height map
-		{
-			this->height_map->Use();
-			height_map->setInt("u_texture", 0);
-			height_map->setInt("heightMap", 1);
-			height_map->setInt("u_heightMap", 2);
-			height_map->setInt("tile", 3);
-			height_map->setInt("ripple", 4);
-			height_map->setInt("u_ripple", 5);
-			height_map->setInt("skybox", 6);
-
-			
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_2D,height_map_tex[count_height_map]);
-			glActiveTexture(GL_TEXTURE2);
-			glBindTexture(GL_TEXTURE_2D, height_map_tex[count_height_map]);
-			glActiveTexture(GL_TEXTURE3);
-			glBindTexture(GL_TEXTURE_CUBE_MAP, tile_cubemap_tex);
-			glActiveTexture(GL_TEXTURE4);
-			glBindTexture(GL_TEXTURE_2D, ripple_tex);
-			glActiveTexture(GL_TEXTURE5);
-			glBindTexture(GL_TEXTURE_2D, ripple_tex);
-			glActiveTexture(GL_TEXTURE6);
-			glBindTexture(GL_TEXTURE_CUBE_MAP, skybox_cubemap_tex);
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, texture->id);
-
-			glUniform1f(glGetUniformLocation(this->height_map->Program, "amplitude"), tw->amplitude->value());
-			glUniform1f(glGetUniformLocation(this->height_map->Program, "f_amplitude"), tw->amplitude->value());
-			GLint viewPosLoc = glGetUniformLocation(this->height_map->Program, "viewPos");
-			glUniform3f(viewPosLoc, viewerPos.x, viewerPos.y, viewerPos.z);
-			glUniform1f(glGetUniformLocation(this->height_map->Program, "material.shininess"),100.0f);
-
-			glUniform3f(glGetUniformLocation(this->height_map->Program, "dirLight.direction"), 0, -20.0f, 0);
-			glUniform3f(glGetUniformLocation(this->height_map->Program, "dirLight.ambient"), 0, 0, 0);
-			glUniform3f(glGetUniformLocation(this->height_map->Program, "dirLight.diffuse"), 0.5, 0.5, 0.5);
-			glUniform3f(glGetUniformLocation(this->height_map->Program, "dirLight.specular"), 1.0, 1.0, 1.0);
-
-			glUniform3f(glGetUniformLocation(this->height_map->Program, "pointLights[0].position"), pointLightPositions[0].x, pointLightPositions[0].y, pointLightPositions[0].z);
-			glUniform3f(glGetUniformLocation(this->height_map->Program, "pointLights[0].ambient"), 0.05f, 0.05f, 0.05f);
-			glUniform3f(glGetUniformLocation(this->height_map->Program, "pointLights[0].diffuse"), 0.8f, 0.8f, 0.8f);
-			glUniform3f(glGetUniformLocation(this->height_map->Program, "pointLights[0].specular"), 1.0f, 1.0f, 1.0f);
-			glUniform1f(glGetUniformLocation(this->height_map->Program, "pointLights[0].constant"), 1.0f);
-			glUniform1f(glGetUniformLocation(this->height_map->Program, "pointLights[0].linear"), 0.09);
-			glUniform1f(glGetUniformLocation(this->height_map->Program, "pointLights[0].quadratic"), 0.032);
-
-			glUniformMatrix4fv(
-				glGetUniformLocation(this->height_map->Program, "u_model"), 1, GL_FALSE, &model_matrix[0][0]);
-		}
-		//bind VAO
-		glBindVertexArray(this->plane->vao);
-
-		glDrawArrays(GL_TRIANGLES, 0, this->plane->element_amount);
 
-		//unbind VAO
-		glBindVertexArray(0);
+		// the rest of the scene is recorded, sorted by state, then drawn
+		submitSkybox(draw_list, frame.view, frame.projection, viewerPos);
+		submitTile(draw_list, frame.view, frame.projection, viewerPos);
+		submitWater(draw_list, viewerPos);
+		draw_list.execute();
+		resolution.end();
 
-		//unbind shader(switch to fixed pipeline)
-		glUseProgram(0);
-	
-
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		glDisable(GL_DEPTH_TEST); 
+		state.bindFramebuffer(0);
+		state.viewport(0, 0, frame.width, frame.height);
+		state.setEnabled(GL_DEPTH_TEST, false);
 		glClearColor(1.0f, 1.0f, 1.0f, 1.0f); 
 		glClear(GL_COLOR_BUFFER_BIT);
-		this->screen->Use();
-		//glUniform1i(glGetUniformLocation(screen->Program, "frame_buffer_type"), tw->frame_buffer_type->value());
-		glUniform1f(glGetUniformLocation(screen->Program, "screen_w"), w());
-		glUniform1f(glGetUniformLocation(screen->Program, "screen_h"), h());
-		glUniform1f(glGetUniformLocation(screen->Program, "isPixel"),tw->pixel->value());
-		//glUniform1f(glGetUniformLocation(screen->Program, "t"), tw->time * 20);
-		glBindVertexArray(screen_quadVAO);
-		glBindTexture(GL_TEXTURE_2D, screen_textureColorbuffer);	// use the color attachment texture as the texture of the quad plane
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-		//unbind shader(switch to fixed pipeline)
-		glUseProgram(0);
+		// the scene (the corner of the screen texture it filled) through
+		// the post-processing and into the window. it is sharpened back
+		// more the smaller it was rendered
+		PostProcess::Settings effects;
+		effects.bloom = frame.bloom;
+		effects.tonemap = frame.tonemap;
+		effects.pixelate = frame.pixelate;
+		effects.fxaa = frame.fxaa;
+		PostProcess::Scene scene = { screen_textureColorbuffer, frame.width, frame.height, scene_size.x, scene_size.y,
+			1.5f * (1.0f - resolution.scale()) };
+		post.run(scene, effects, frame.width, frame.height, screen_quadVAO);
+
+		// the finished frame, on its way to the recording
+		if (frame.record != record_requested) {
+			record_requested = frame.record;
+			settled_frames = 0;
+			if (frame.record)
+				capture.start(captureName(), frame.record_y4m ? FrameCapture::FORMAT_Y4M : FrameCapture::FORMAT_PNG, captureRate);
+			else
+				capture.stop();
+		}
+		capture.capture(frame.width, frame.height);
+		// leave nothing bound for FLTK (it draws with the fixed pipeline)
+		state.bindVertexArray(0);
+		state.useProgram(0);
+
+		// this frame's part of the stream buffer is free once all of that
+		// is done
+		stream.endFrame();
 	}
 }
 
@@ -1100,17 +1539,37 @@ void TrainView::draw()
 // * This sets up both the Projection and the ModelView matrices
 //   HOWEVER: it doesn't clear the projection first (the caller handles
 //   that) - its important for picking
+//   the matrices are the frame's (computeCamera's, when it was captured),
+//   the fixed-function stack just gets a copy (the lights still use it)
 //========================================================================
 void TrainView::
 setProjection()
 //========================================================================
+{
+	glMatrixMode(GL_PROJECTION);
+	glMultMatrixf(&frame.projection[0][0]);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadMatrixf(&frame.view[0][0]);
+}
+
+//************************************************************************
+//
+// * Work out view_matrix and projection_matrix for the current camera
+//   on the CPU - everything that needs them (the shared matrices, the 
+//   skybox and tile, picking) reads them from here, not back from GL
+//========================================================================
+void TrainView::
+computeCamera()
+//========================================================================
 {
 	// Compute the aspect ratio (we'll need it)
 	float aspect = static_cast<float>(w()) / static_cast<float>(h());
 
 	// Check whether we use the world camp
-	if (tw->worldCam->value())
-		arcball.setProjection(false);
+	if (tw->worldCam->value()) {
+		view_matrix = arcball.getViewMatrix();
+		projection_matrix = arcball.getProjectionMatrix();
+	}
 	// Or we use the top cam
 	else if (tw->topCam->value()) {
 		float wi, he;
@@ -1125,11 +1584,8 @@ setProjection()
 
 		// Set up the top camera drop mode to be orthogonal and set
 		// up proper projection matrix
-		glMatrixMode(GL_PROJECTION);
-		glOrtho(-wi, wi, -he, he, 200, -200);
-		glMatrixMode(GL_MODELVIEW);
-		glLoadIdentity();
-		glRotatef(-90,1,0,0);
+		projection_matrix = glm::ortho(-wi, wi, -he, he, 200.0f, -200.0f);
+		view_matrix = glm::rotate(glm::mat4(), glm::radians(-90.0f), glm::vec3(1, 0, 0));
 	} 
 	// Or do the train view or other view here
 	//####################################################################
@@ -1139,6 +1595,13 @@ setProjection()
 	else {
 #ifdef EXAMPLE_SOLUTION
 		trainCamView(this,aspect);
+#else
+		// ride the first vessel (or the track, without one), a little
+		// above it, looking ahead
+		TrackSpline::Frame f = fleet.size() ? fleet.vessel(0) : spline.frame(m_pTrack->trainU);
+		glm::vec3 eye = f.position + 5.0f * f.up;
+		view_matrix = glm::lookAt(eye, eye + f.tangent, f.up);
+		projection_matrix = glm::perspective(glm::radians(60.0f), aspect, .1f, 1000.0f);
 #endif
 	}
 }
@@ -1160,17 +1623,8 @@ void TrainView::drawStuff(bool doingShadows)
 	// Draw the control points
 	// don't draw the control points if you're driving 
 	// (otherwise you get sea-sick as you drive through them)
-	if (!tw->trainCam->value()) {
-		for(size_t i=0; i<m_pTrack->points.size(); ++i) {
-			if (!doingShadows) {
-				if ( ((int) i) != selectedCube)
-					glColor3ub(240, 60, 60);
-				else
-					glColor3ub(240, 240, 30);
-			}
-			m_pTrack->points[i].draw();
-		}
-	}
+	if (!frame.train_cam)
+		drawControlPoints(doingShadows);
 	//std::cout << m_pTrack->points[0].pos.x<<std::endl;
 	// draw the track
 	//####################################################################
@@ -1180,8 +1634,12 @@ void TrainView::drawStuff(bool doingShadows)
 
 #ifdef EXAMPLE_SOLUTION
 	drawTrack(this, doingShadows);
+#else
+	drawTrackMesh(doingShadows);
 #endif
 
+	drawVessels(doingShadows);
+
 	// draw the train
 	//####################################################################
 	// TODO: 
@@ -1189,17 +1647,465 @@ void TrainView::drawStuff(bool doingShadows)
 	//####################################################################
 #ifdef EXAMPLE_SOLUTION
 	// don't draw the train if you're looking out the front window
-	if (!tw->trainCam->value())
+	if (!frame.train_cam)
 		drawTrain(this, doingShadows);
 #endif
 }
 
+//************************************************************************
+//
+// * Draw every control point in one instanced call. The instances go
+//   into the stream buffer once a frame - the probe faces, the normal
+//   pass and the shadow pass (which just squishes them onto the floor)
+//   all draw from that copy
+//========================================================================
+void TrainView::
+drawControlPoints(bool doingShadows)
+//========================================================================
+{
+	// the instance data was put together when the frame was captured
+	const std::vector<GLfloat>& instances = frame.control_points;
+	size_t npts = instances.size() / 7;
+	if (!npts)
+		return;
+
+	if (instances_frame != stream.frame()) {
+		StreamBuffer::Allocation uploaded = stream.upload(&instances[0], instances.size() * sizeof(GLfloat));
+		// no room this frame (there will be on the next)
+		if (!uploaded.valid())
+			return;
+		StateCache::instance().bindVertexArray(control_point_glyph->vao);
+		glBindVertexBuffer(controlPointInstances, stream.buffer(), uploaded.offset, 7 * sizeof(GLfloat));
+		instances_frame = stream.frame();
+	}
+
+	control_point->Use();
+	glUniform1i(glGetUniformLocation(control_point->Program, "u_shadow"), doingShadows);
+	glUniform1i(glGetUniformLocation(control_point->Program, "u_top_view"), frame.top_cam);
+	StateCache& state = StateCache::instance();
+	state.bindVertexArray(control_point_glyph->vao);
+	glDrawArraysInstanced(GL_TRIANGLES, 0, control_point_glyph->count, (GLsizei) npts);
+	// the rest of drawStuff may be fixed-function
+	state.useProgram(0);
+}
+
+//************************************************************************
+//
+// * Bring the spline and the track's mesh up to date with the points.
+//   the mesh takes the segments the spline measured again, so the two
+//   go together
+//========================================================================
+void TrainView::
+updateTrack()
+//========================================================================
+{
+	if (spline.update(*m_pTrack, tw->splineType()))
+		track_mesh.update(spline);
+}
+
+//************************************************************************
+//
+// * Put the blocks of the track that changed into its buffer: runs of
+//   neighbouring segments go in one copy each. a new number of segments
+//   makes the buffers over (and then every block has changed)
+//========================================================================
+void TrainView::
+uploadTrack()
+//========================================================================
+{
+	const size_t blockBytes = TrackMesh::verticesPerSegment * sizeof(TrackMesh::Vertex);
+	StateCache& state = StateCache::instance();
+
+	if (frame.track_segments != track_segments) {
+		track_segments = frame.track_segments;
+		settled_frames = 0;
+		std::vector<unsigned int> indices;
+		TrackMesh::indices(track_segments, indices);
+		track_vao->element_amount = (unsigned int) indices.size();
+
+		state.bindVertexArray(track_vao->vao);
+		glBindBuffer(GL_ARRAY_BUFFER, track_vao->vbo[0]);
+		glBufferData(GL_ARRAY_BUFFER, track_segments * blockBytes, nullptr, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, track_vao->ebo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
+			indices.empty() ? nullptr : &indices[0], GL_STATIC_DRAW);
+		GpuResources::instance().buffer(track_vao->vbo[0], "track", "vertices", track_segments * blockBytes);
+		GpuResources::instance().buffer(track_vao->ebo, "track", "indices", indices.size() * sizeof(unsigned int));
+	}
+
+	const std::vector<int>& changed = frame.track_changed;
+	if (changed.empty() || !track_segments)
+		return;
+	glBindBuffer(GL_ARRAY_BUFFER, track_vao->vbo[0]);
+	for (size_t first = 0; first < changed.size(); ) {
+		size_t last = first;
+		while (last + 1 < changed.size() && changed[last + 1] == changed[last] + 1)
+			++last;
+		glBufferSubData(GL_ARRAY_BUFFER, changed[first] * blockBytes, (last - first + 1) * blockBytes,
+			&frame.track_vertices[first * TrackMesh::verticesPerSegment]);
+		first = last + 1;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+//************************************************************************
+//
+// * The whole track in one draw (squished onto the floor for the shadow)
+//========================================================================
+void TrainView::
+drawTrackMesh(bool doingShadows)
+//========================================================================
+{
+	if (!track_vao->element_amount)
+		return;
+	track->Use();
+	glUniform1i(glGetUniformLocation(track->Program, "u_shadow"), doingShadows);
+	glUniform1i(glGetUniformLocation(track->Program, "u_top_view"), frame.top_cam);
+	StateCache& state = StateCache::instance();
+	state.bindVertexArray(track_vao->vao);
+	glDrawElements(GL_TRIANGLES, track_vao->element_amount, GL_UNSIGNED_INT, (GLvoid*)0);
+	// the rest of drawStuff may be fixed-function
+	state.useProgram(0);
+}
+
+//************************************************************************
+//
+// * Every vessel in one instanced call - but the one the train camera is
+//   on (the first), which would only be in the way
+//========================================================================
+void TrainView::
+drawVessels(bool doingShadows)
+//========================================================================
+{
+	const std::vector<GLfloat>& instances = frame.vessels;
+	GLuint first = frame.train_cam ? 1 : 0;
+	GLuint count = (GLuint) (instances.size() / Fleet::instanceFloats);
+	if (count <= first)
+		return;
+
+	if (vessels_frame != stream.frame()) {
+		StreamBuffer::Allocation uploaded = stream.upload(&instances[0], instances.size() * sizeof(GLfloat));
+		if (!uploaded.valid())
+			return;
+		StateCache::instance().bindVertexArray(hull->vao);
+		glBindVertexBuffer(vesselInstances, stream.buffer(), uploaded.offset, Fleet::instanceFloats * sizeof(GLfloat));
+		vessels_frame = stream.frame();
+	}
+
+	vessel->Use();
+	glUniform1i(glGetUniformLocation(vessel->Program, "u_shadow"), doingShadows);
+	glUniform1i(glGetUniformLocation(vessel->Program, "u_top_view"), frame.top_cam);
+	StateCache& state = StateCache::instance();
+	state.bindVertexArray(hull->vao);
+	glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, hull->count, count - first, first);
+	// the rest of drawStuff may be fixed-function
+	state.useProgram(0);
+}
+
+//************************************************************************
+//
+// * Every footprint, added onto the simulation step in the framebuffer -
+//   one draw however many vessels there are, and only their pixels
+//========================================================================
+void TrainView::
+splashWakes()
+//========================================================================
+{
+	const std::vector<GLfloat>& wakes = frame.wakes;
+	GLsizei count = (GLsizei) (wakes.size() / Fleet::wakeFloats);
+	if (!count)
+		return;
+	StreamBuffer::Allocation uploaded = stream.upload(&wakes[0], wakes.size() * sizeof(GLfloat));
+	if (!uploaded.valid())
+		return;
+
+	StateCache& state = StateCache::instance();
+	wake->Use();
+	glUniform2f(glGetUniformLocation(wake->Program, "u_half_size"), frame.wake_size.x, frame.wake_size.y);
+	state.bindVertexArray(wake_vao);
+	glBindVertexBuffer(wakeInstances, stream.buffer(), uploaded.offset, Fleet::wakeFloats * sizeof(GLfloat));
+	state.setEnabled(GL_BLEND, true);
+	state.blendFunc(GL_ONE, GL_ONE);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+	state.setEnabled(GL_BLEND, false);
+}
+
+//************************************************************************
+//
+// * the skybox, centred on the eye. it is put on the far plane and drawn
+//	  after everything else, so it only shades the pixels left uncovered
+//========================================================================
+void TrainView::
+submitSkybox(DrawList& list, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& eye)
+//========================================================================
+{
+	DrawList::State sky;
+	sky.program = skybox->Program;
+	sky.vertex_array = skybox_vao;
+	sky.addTexture(0, GL_TEXTURE_CUBE_MAP, skybox_cubemap_tex);
+	sky.depth_func = GL_LEQUAL;
+
+	glm::mat4 skybox_matrix = glm::mat4();
+	skybox_matrix = glm::translate(skybox_matrix, eye);
+	skybox_matrix = glm::scale(skybox_matrix, glm::vec3(600.0f, 600.0f, 600.0f));
+	GLuint program = skybox->Program;
+	list.submit(DrawList::PASS_BACKGROUND, list.material(sky), DrawList::maxDistance, GL_TRIANGLES, 0, 36,
+		[program, view, projection, skybox_matrix]() {
+			glUniformMatrix4fv(glGetUniformLocation(program, "u_projection"), 1, GL_FALSE, &projection[0][0]);
+			glUniformMatrix4fv(glGetUniformLocation(program, "u_view"), 1, GL_FALSE, &view[0][0]);
+			glUniformMatrix4fv(glGetUniformLocation(program, "s_model"), 1, GL_FALSE, &skybox_matrix[0][0]);
+		});
+}
+
+//************************************************************************
+//
+// * the tiled pool around the water
+//========================================================================
+void TrainView::
+submitTile(DrawList& list, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& eye)
+//========================================================================
+{
+	DrawList::State pool;
+	pool.program = tile->Program;
+	pool.vertex_array = tile_vao;
+	pool.addTexture(0, GL_TEXTURE_CUBE_MAP, tile_cubemap_tex);
+	pool.addTexture(1, GL_TEXTURE_CUBE_MAP, skybox_cubemap_tex);
+	pool.addTexture(2, GL_TEXTURE_2D, height_map_tex[frame.height_map]);
+	pool.addSampler("tile", 0);
+	pool.addSampler("skybox", 1);
+	pool.addSampler("heightmap", 2);
+	pool.depth_func = GL_LEQUAL;
+	pool.cull = true;
+	pool.front_face = GL_CW;
+	pool.cull_face = GL_FRONT;
+
+	glm::mat4 tile_matrix = glm::mat4();
+	tile_matrix = glm::scale(tile_matrix, glm::vec3(100.0f, 100.0f, 100.0f));
+	GLuint program = tile->Program;
+	float amplitude = frame.amplitude;
+	list.submit(DrawList::PASS_OPAQUE, list.material(pool), glm::length(eye), GL_TRIANGLES, 0, 30,
+		[program, view, projection, tile_matrix, eye, amplitude]() {
+			glUniform3f(glGetUniformLocation(program, "cameraPos"), eye.x, eye.y, eye.z);
+			glUniform1f(glGetUniformLocation(program, "amplitude"), amplitude);
+			glUniformMatrix4fv(glGetUniformLocation(program, "u_projection"), 1, GL_FALSE, &projection[0][0]);
+			glUniformMatrix4fv(glGetUniformLocation(program, "u_view"), 1, GL_FALSE, &view[0][0]);
+			glUniformMatrix4fv(glGetUniformLocation(program, "s_model"), 1, GL_FALSE, &tile_matrix[0][0]);
+		});
+}
+
+//************************************************************************
+//
+// * the water, in whichever wave mode is picked
+//	  it keeps the tile's culling (the plane is only seen from above).
+//	  with the prepass on, the surface is first drawn for depth only (the
+//	  same vertex shader, nothing shaded), so the expensive shading only
+//	  runs once per pixel, on the nearest wave
+//========================================================================
+void TrainView::
+submitWater(DrawList& list, const glm::vec3& eye)
+//========================================================================
+{
+	// the one point light the water shaders use
+	glm::vec3 light(0.0f, 10.0f, 0.0f);
+
+	glm::mat4 model_matrix = glm::mat4();
+	model_matrix = glm::translate(model_matrix, this->source_pos);
+	model_matrix = glm::scale(model_matrix, glm::vec3(100.0f, 100.0f, 100.0f));
+
+	DrawList::State surface;
+	surface.vertex_array = this->plane->vao;
+	surface.cull = true;
+	surface.front_face = GL_CW;
+	surface.cull_face = GL_FRONT;
+	bool prepass = frame.prepass;
+	if (prepass) {
+		surface.depth_func = GL_LEQUAL;
+		surface.depth_write = false;
+	}
+	DrawList::State depth = surface;
+	depth.color_write = false;
+	depth.depth_func = GL_LESS;
+	depth.depth_write = true;
+
+	float distance = glm::length(this->source_pos - eye);
+	float amplitude = frame.amplitude;
+	GLsizei vertices = this->plane->element_amount;
+
+	if (frame.wave == 1) //sin wave
+	{
+		surface.program = this->water->Program;
+		surface.addTexture(0, GL_TEXTURE_2D, this->texture->id);
+		surface.addTexture(4, GL_TEXTURE_2D, ripple_tex);
+		surface.addSampler("ripple", 4);
+		surface.addSampler("u_ripple", 4);
+		depth.program = this->water_depth->Program;
+		depth.addTexture(4, GL_TEXTURE_2D, ripple_tex);
+		depth.addSampler("ripple", 4);
+
+		float time = frame.time;
+		float speed = frame.speed;
+		float wave_length = frame.wave_length;
+		// the uniforms for either program (the prepass ignores the lights)
+		WaterLighting lighting = {};
+		lighting.view_pos = glm::vec4(eye, 0.0f);
+		lighting.shininess.x = 32.0f;
+		lighting.direction = glm::vec4(-0.2f, -1.0f, -0.3f, 0.0f);
+		lighting.ambient = glm::vec4(0.0f);
+		lighting.diffuse = glm::vec4(0.1f, 0.1f, 0.1f, 0.0f);
+		lighting.specular = glm::vec4(0.5f, 0.5f, 0.5f, 0.0f);
+		WaterLighting::PointLight& point = lighting.point_lights[0];
+		point.position = light;
+		point.ambient = glm::vec4(0.0f);
+		point.diffuse = glm::vec4(0.8f, 0.8f, 0.8f, 0.0f);
+		point.specular = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+		point.constant = 1.0f;
+		point.linear = 0.09f;
+		point.quadratic = 0.032f;
+		StreamBuffer::Allocation block = stream.upload(&lighting, sizeof(lighting), stream.uniformAlignment());
+		if (!block.valid())
+			return;
+		GLuint buffer = stream.buffer();
+
+		auto uniforms = [model_matrix, time, speed, amplitude, wave_length, buffer, block](GLuint program) {
+			glUniform1f(glGetUniformLocation(program, "time"), time);
+			glUniform1f(glGetUniformLocation(program, "speed"), speed);
+			glUniform1f(glGetUniformLocation(program, "amplitude"), amplitude);
+			glUniform1f(glGetUniformLocation(program, "waveLength"), wave_length);
+			glUniform1f(glGetUniformLocation(program, "u_ripple_height"), WaterSurface::rippleHeight);
+			glBindBufferRange(GL_UNIFORM_BUFFER, waterLightingBinding, buffer, block.offset, block.size);
+
+			glUniformMatrix4fv(glGetUniformLocation(program, "u_model"), 1, GL_FALSE, &model_matrix[0][0]);
+		};
+		GLuint program = surface.program, depth_program = depth.program;
+		if (prepass)
+			list.submit(DrawList::PASS_DEPTH, list.material(depth), distance, GL_TRIANGLES, 0, vertices,
+				[uniforms, depth_program]() { uniforms(depth_program); });
+		list.submit(DrawList::PASS_WATER, list.material(surface), distance, GL_TRIANGLES, 0, vertices,
+			[uniforms, program]() { uniforms(program); });
+	}
+	else if (frame.wave == 2) //height map
+	{
+		surface.program = this->height_map->Program;
+		// the vertex and fragment stages read the same height map and
+		// ripples, so they share units
+		surface.addTexture(0, GL_TEXTURE_2D, texture->id);
+		surface.addTexture(1, GL_TEXTURE_2D, height_map_tex[frame.height_map]);
+		surface.addTexture(3, GL_TEXTURE_CUBE_MAP, tile_cubemap_tex);
+		surface.addTexture(4, GL_TEXTURE_2D, ripple_tex);
+		surface.addTexture(6, GL_TEXTURE_CUBE_MAP, skybox_cubemap_tex);
+		surface.addTexture(7, GL_TEXTURE_CUBE_MAP, environment.prefiltered);
+		surface.addTexture(8, GL_TEXTURE_2D, environment.brdf_lut);
+		surface.addTexture(9, GL_TEXTURE_CUBE_MAP, probe.cubemap);
+		surface.addSampler("u_texture", 0);
+		surface.addSampler("heightMap", 1);
+		surface.addSampler("u_heightMap", 1);
+		surface.addSampler("tile", 3);
+		surface.addSampler("ripple", 4);
+		surface.addSampler("u_ripple", 4);
+		surface.addSampler("skybox", 6);
+		surface.addSampler("u_environment", 7);
+		surface.addSampler("u_brdf", 8);
+		surface.addSampler("u_probe", 9);
+		// the vertices only need the height map and the ripples
+		depth.program = this->height_map_depth->Program;
+		depth.addTexture(1, GL_TEXTURE_2D, height_map_tex[frame.height_map]);
+		depth.addTexture(4, GL_TEXTURE_2D, ripple_tex);
+		depth.addSampler("heightMap", 1);
+		depth.addSampler("ripple", 4);
+
+		float roughness = frame.roughness;
+		bool use_probe = frame.probe_faces > 0;
+		float probe_lod = (float) (probe.levels() - 1);
+		WaterLighting lighting = {};
+		lighting.view_pos = glm::vec4(eye, 0.0f);
+		lighting.shininess.x = 100.0f;
+		lighting.direction = glm::vec4(0.0f, -20.0f, 0.0f, 0.0f);
+		lighting.ambient = glm::vec4(0.0f);
+		lighting.diffuse = glm::vec4(0.5f, 0.5f, 0.5f, 0.0f);
+		lighting.specular = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+		WaterLighting::PointLight& point = lighting.point_lights[0];
+		point.position = light;
+		point.ambient = glm::vec4(0.05f, 0.05f, 0.05f, 0.0f);
+		point.diffuse = glm::vec4(0.8f, 0.8f, 0.8f, 0.0f);
+		point.specular = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+		point.constant = 1.0f;
+		point.linear = 0.09f;
+		point.quadratic = 0.032f;
+		StreamBuffer::Allocation block = stream.upload(&lighting, sizeof(lighting), stream.uniformAlignment());
+		if (!block.valid())
+			return;
+		GLuint buffer = stream.buffer();
+
+		auto uniforms = [model_matrix, amplitude, roughness, use_probe, probe_lod, buffer, block](GLuint program) {
+			glUniform1f(glGetUniformLocation(program, "u_roughness"), roughness);
+			glUniform1f(glGetUniformLocation(program, "u_environment_lod"), (float) (EnvironmentMap::levelCount - 1));
+			glUniform1i(glGetUniformLocation(program, "u_use_probe"), use_probe);
+			glUniform1f(glGetUniformLocation(program, "u_probe_lod"), probe_lod);
+
+			glUniform1f(glGetUniformLocation(program, "amplitude"), amplitude);
+			glUniform1f(glGetUniformLocation(program, "f_amplitude"), amplitude);
+			glUniform1f(glGetUniformLocation(program, "u_ripple_height"), WaterSurface::rippleHeight);
+			glBindBufferRange(GL_UNIFORM_BUFFER, waterLightingBinding, buffer, block.offset, block.size);
+
+			glUniformMatrix4fv(glGetUniformLocation(program, "u_model"), 1, GL_FALSE, &model_matrix[0][0]);
+		};
+		GLuint program = surface.program, depth_program = depth.program;
+		if (prepass)
+			list.submit(DrawList::PASS_DEPTH, list.material(depth), distance, GL_TRIANGLES, 0, vertices,
+				[uniforms, depth_program]() { uniforms(depth_program); });
+		list.submit(DrawList::PASS_WATER, list.material(surface), distance, GL_TRIANGLES, 0, vertices,
+			[uniforms, program]() { uniforms(program); });
+	}
+}
+
+//************************************************************************
+//
+// * render the scene into the reflection probe at the middle of the water
+//	  only frame.probe_faces faces a frame (none turns the probe off, and the
+//	  water falls back to the prefiltered skybox). the first time round
+//	  all six are drawn, so there is never an empty face
+//========================================================================
+void TrainView::
+updateProbe()
+//========================================================================
+{
+	int budget = frame.probe_faces;
+	if (!budget)
+		return;
+	if (!probe.primed())
+		budget = 6;
+
+	// just above the water, so the waves don't cut through it
+	probe.position = this->source_pos + glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::mat4 projection = probe.projection();
+
+	StateCache::instance().setEnabled(GL_DEPTH_TEST, true);
+	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+	for (int i = 0; i < budget; i++) {
+		int face = probe.nextFace();
+		glm::mat4 view = probe.view(face);
+		probe.begin(face);
+
+		// the control points read the shared matrices
+		setUBO(view, projection);
+		drawControlPoints(false);
+		submitSkybox(draw_list, view, projection, probe.position);
+		submitTile(draw_list, view, projection, probe.position);
+		draw_list.execute();
+	}
+	probe.finish();
+
+	StateCache::instance().viewport(0, 0, frame.width, frame.height);
+	setUBO();
+}
+
 // 
 //************************************************************************
 //
 // * this tries to see which control point is under the mouse
 //	  (for when the mouse is clicked)
-//		it uses OpenGL picking - which is always a trick
+//		it casts the mouse ray on the CPU against the picker's hierarchy,
+//		so no OpenGL is involved and the closest point wins
 //########################################################################
 // TODO: 
 //		if you want to pick things other than control points, or you
@@ -1210,72 +2116,47 @@ void TrainView::
 doPick()
 //========================================================================
 {
-	// since we'll need to do some GL stuff so we make this window as 
-	// active window
-	make_current();		
+	glm::vec3 origin, dir;
+	getMouseRay(origin, dir);
 
-	// where is the mouse?
-	int mx = Fl::event_x(); 
-	int my = Fl::event_y();
+	selectedCube = picker.pick(*m_pTrack, origin, dir);
 
-	// get the viewport - most reliable way to turn mouse coords into GL coords
-	int viewport[4];
-	glGetIntegerv(GL_VIEWPORT, viewport);
-
-	// Set up the pick matrix on the stack - remember, FlTk is
-	// upside down!
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity ();
-
-	gluPickMatrix((double)mx, (double)(viewport[3]-my), 
-						5, 5, viewport);
-
-	// now set up the projection
-	setProjection();
-
-	// now draw the objects - but really only see what we hit
-	GLuint buf[100];
-	glSelectBuffer(100,buf);
-	glRenderMode(GL_SELECT);
-	glInitNames();
-	glPushName(0);
+	printf("Selected Cube %d\n",selectedCube);
+}
 
-	// draw the cubes, loading the names as we go
-	for(size_t i=0; i<m_pTrack->points.size(); ++i) {
-		glLoadName((GLuint) (i+1));
-		m_pTrack->points[i].draw();
-	}
+//************************************************************************
+//
+// * Turn the mouse position into a ray by un-projecting it through the
+//   matrices of the last frame (that is what the user is looking at)
+//========================================================================
+void TrainView::
+getMouseRay(glm::vec3& origin, glm::vec3& dir)
+//========================================================================
+{
+	// remember, FlTk is upside down!
+	float x = 2.0f * Fl::event_x() / w() - 1.0f;
+	float y = 1.0f - 2.0f * Fl::event_y() / h();
 
-	// go back to drawing mode, and see how picking did
-	int hits = glRenderMode(GL_RENDER);
-	if (hits) {
-		// warning; this just grabs the first object hit - if there
-		// are multiple objects, you really want to pick the closest
-		// one - see the OpenGL manual 
-		// remember: we load names that are one more than the index
-		selectedCube = buf[3]-1;
-	} else // nothing hit, nothing selected
-		selectedCube = -1;
+	glm::mat4 inv = glm::inverse(projection_matrix * view_matrix);
+	glm::vec4 pnear = inv * glm::vec4(x, y, -1.0f, 1.0f);
+	glm::vec4 pfar  = inv * glm::vec4(x, y,  1.0f, 1.0f);
 
-	printf("Selected Cube %d\n",selectedCube);
+	origin = glm::vec3(pnear) / pnear.w;
+	dir = glm::normalize(glm::vec3(pfar) / pfar.w - origin);
 }
 
 void TrainView::setUBO()
 {
-	float wdt = this->pixel_w();
-	float hgt = this->pixel_h();
-
-	glm::mat4 view_matrix;
-	glGetFloatv(GL_MODELVIEW_MATRIX, &view_matrix[0][0]);
-	/*HMatrix view_matrix; 
-	this->arcball.getMatrix(view_matrix);*/
-
-	glm::mat4 projection_matrix;
-	glGetFloatv(GL_PROJECTION_MATRIX, &projection_matrix[0][0]);
-	//projection_matrix = glm::perspective(glm::radians(this->arcball.getFoV()), (GLfloat)wdt / (GLfloat)hgt, 0.01f, 1000.0f);
-
-	glBindBuffer(GL_UNIFORM_BUFFER, this->commom_matrices->ubo);
-	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), &projection_matrix[0][0]);
-	glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), &view_matrix[0][0]);
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	// the camera the frame was captured with
+	setUBO(frame.view, frame.projection);
+}
+
+void TrainView::setUBO(const glm::mat4& view, const glm::mat4& projection)
+{
+	// a fresh block from the stream buffer each time, so a draw still
+	// waiting to read the last one isn't disturbed
+	glm::mat4 matrices[2] = { projection, view };
+	StreamBuffer::Allocation block = stream.upload(matrices, sizeof(matrices), stream.uniformAlignment());
+	if (block.valid())
+		glBindBufferRange(GL_UNIFORM_BUFFER, /*binding point*/0, stream.buffer(), block.offset, block.size);
 }
\ No newline at end of file
@@ -129,6 +129,38 @@ TrainWindow(const int x, const int y)
 
 		pty += 25;
 
+		roughness = new Fl_Value_Slider(670, pty, 120, 20, "Roughness");
+		roughness->range(0, 1);
+		roughness->value(0.1);
+		roughness->align(FL_ALIGN_LEFT);
+		roughness->type(FL_HORIZONTAL);
+		roughness->callback((Fl_Callback*)damageCB, this);
+
+		pty += 25;
+
+		// faces of the reflection probe redrawn each frame (0 = no probe)
+		probeFaces = new Fl_Value_Slider(670, pty, 120, 20, "Probe Faces");
+		probeFaces->range(0, 6);
+		probeFaces->step(1);
+		probeFaces->value(1);
+		probeFaces->align(FL_ALIGN_LEFT);
+		probeFaces->type(FL_HORIZONTAL);
+		probeFaces->callback((Fl_Callback*)damageCB, this);
+
+		pty += 25;
+
+		// GPU milliseconds the scene may take before its resolution drops
+		// (0 = always full resolution)
+		sceneBudget = new Fl_Value_Slider(670, pty, 120, 20, "Scene ms");
+		sceneBudget->range(0, 33);
+		sceneBudget->step(1);
+		sceneBudget->value(12);
+		sceneBudget->align(FL_ALIGN_LEFT);
+		sceneBudget->type(FL_HORIZONTAL);
+		sceneBudget->callback((Fl_Callback*)damageCB, this);
+
+		pty += 25;
+
 		// add and delete points
 		Fl_Button* ap = new Fl_Button(605,pty,80,20,"Add Point");
 		ap->callback((Fl_Callback*)addPointCB,this);
@@ -155,9 +187,74 @@ TrainWindow(const int x, const int y)
 		Fl_Button* rzp = new Fl_Button(700,pty,30,20,"R-Z");
 		rzp->callback((Fl_Callback*)rmzCB,this);
 
+		pty += 25;
+
+		// the curve through the points - in a radio button group
+		Fl_Group* splineGroup = new Fl_Group(600,pty,195,20);
+		splineGroup->begin();
+		linearSpline = new Fl_Button(605, pty, 60, 20, "Linear");
+		cardinalSpline = new Fl_Button(670, pty, 60, 20, "Cardinal");
+		bSpline = new Fl_Button(735, pty, 60, 20, "B-Spline");
+		Fl_Button* splineButtons[] = { linearSpline, cardinalSpline, bSpline };
+		for (Fl_Button* b : splineButtons) {
+			b->type(FL_RADIO_BUTTON);
+			b->value(b == cardinalSpline);
+			b->selection_color((Fl_Color)3);
+			b->callback((Fl_Callback*)damageCB,this);
+		}
+		splineGroup->end();
+
+		pty += 25;
+
+		// boats along the track, the first one where the train would be
+		vessels = new Fl_Value_Slider(670, pty, 120, 20, "Vessels");
+		vessels->range(0, Fleet::maxVessels);
+		vessels->step(1);
+		vessels->value(1);
+		vessels->align(FL_ALIGN_LEFT);
+		vessels->type(FL_HORIZONTAL);
+		vessels->callback((Fl_Callback*)damageCB, this);
+
 		pty+=30;
 		pixel = new Fl_Button(605, pty, 40, 20, "pixel");
 		togglify(pixel);
+		// lay down the water's depth before shading it
+		prepass = new Fl_Button(650, pty, 60, 20, "Prepass");
+		togglify(prepass);
+
+		// the post-processing passes
+		pty+=25;
+		bloom = new Fl_Button(605, pty, 50, 20, "Bloom");
+		togglify(bloom);
+		tonemap = new Fl_Button(660, pty, 55, 20, "Tone");
+		togglify(tonemap);
+		fxaa = new Fl_Button(720, pty, 45, 20, "FXAA");
+		togglify(fxaa);
+
+		// record what is shown (a PNG sequence, or a Y4M video)
+		pty+=25;
+		record = new Fl_Button(605, pty, 60, 20, "Record");
+		togglify(record);
+		recordY4m = new Fl_Button(670, pty, 45, 20, "Y4M");
+		togglify(recordY4m);
+
+		// video memory: what may be used before the optional textures get
+		// smaller, what is used, and all of it to a file
+		pty+=25;
+		gpuBudget = new Fl_Value_Slider(670, pty, 120, 20, "GPU MB");
+		gpuBudget->range(0, 1024);
+		gpuBudget->step(16);
+		gpuBudget->value(0);
+		gpuBudget->align(FL_ALIGN_LEFT);
+		gpuBudget->type(FL_HORIZONTAL);
+		gpuBudget->callback((Fl_Callback*)damageCB, this);
+
+		pty+=25;
+		Fl_Button* gpuDump = new Fl_Button(605, pty, 50, 20, "Dump");
+		gpuDump->callback((Fl_Callback*)gpuDumpCB, this);
+		gpuMemory = new Fl_Box(660, pty, 135, 20, "GPU");
+		gpuMemory->align(FL_ALIGN_LEFT | FL_ALIGN_INSIDE);
+		gpuMemory->labelsize(12);
 
 		// TODO: add widgets for all of your fancier features here
 #ifdef EXAMPLE_SOLUTION
@@ -203,6 +300,21 @@ damageMe()
 	trainView->damage(1);
 }
 
+//************************************************************************
+//
+// * Which of the spline buttons is down
+//========================================================================
+TrackSpline::Type TrainWindow::
+splineType() const
+//========================================================================
+{
+	if (linearSpline->value())
+		return TrackSpline::Linear;
+	if (bSpline->value())
+		return TrackSpline::BSpline;
+	return TrackSpline::Cardinal;
+}
+
 //************************************************************************
 //
 // * This will get called (approximately) 30 times per second
@@ -221,7 +333,20 @@ advanceTrain(float dir)
 	{
 		trainView->count_height_map -= 200;
 	}
-#ifdef EXAMPLE_SOLUTION
+#ifndef EXAMPLE_SOLUTION
+	// with arc length, speed is distance along the track per step (the
+	// tables make that two binary searches); without, it is parameter
+	TrackSpline& spline = trainView->spline;
+	trainView->updateTrack();
+	if (arcLength->value())
+		m_Track.trainU = spline.advance(m_Track.trainU, dir * (float)speed->value());
+	else
+		m_Track.trainU += dir * ((float)speed->value() * .1f);
+
+	float nct = static_cast<float>(m_Track.points.size());
+	if (m_Track.trainU >= nct) m_Track.trainU -= nct;
+	if (m_Track.trainU < 0) m_Track.trainU += nct;
+#else
 	// note - we give a little bit more example code here than normal,
 	// so you can see how this works
 
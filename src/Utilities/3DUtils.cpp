@@ -224,6 +224,36 @@ void unsetupShadows(void)
   glDisable(GL_BLEND);
 }
 
+//*************************************************************************
+//
+// * The shadows without any fixed-function state (for a core profile)
+//   the squish matrix and the color are up to the shader
+//===============================================================================
+void setupShaderShadows(void)
+//===============================================================================
+{
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	glEnable(GL_STENCIL_TEST);
+	glStencilFunc(GL_EQUAL,0x1,0x1);
+	glStencilOp(GL_KEEP,GL_ZERO,GL_ZERO);
+	glStencilMask(0x1);		// only deal with the 1st bit
+}
+
+//*************************************************************************
+//
+// * Back to "normal" - the same as unsetupShadows, without the matrix
+//===============================================================================
+void unsetupShaderShadows(void)
+//===============================================================================
+{
+	glEnable(GL_DEPTH_TEST);
+	glDisable(GL_STENCIL_TEST);
+	glDisable(GL_BLEND);
+}
+
 
 //*************************************************************************
 //
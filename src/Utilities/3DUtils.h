@@ -96,6 +96,12 @@ void setupShadows(void);
 // Set it back to original projection matrix
 void unsetupShadows(void);
 
+// The same, for a core profile: only the stencil, depth and blending are
+// set up - the shaders have to squish the objects onto the floor and draw 
+// them in transparent black themselves
+void setupShaderShadows(void);
+void unsetupShaderShadows(void);
+
 //************************************************************************
 // stuff for mouse handling
 //************************************************************************
@@ -67,6 +67,9 @@
 #pragma warning(pop)
 
 #include "stdio.h"
+#include <string.h>
+
+#include <glm/gtc/matrix_transform.hpp>
 
 //**************************************************************************
 //
@@ -80,7 +83,9 @@ ArcBallCam()
 		initEyeZ(20), 
 		mode(None), 
 		panX(0), panY(0),
-		isx(0), isy(0), isz(0)
+		isx(0), isy(0), isz(0),
+		viewDirty(true),
+		projAspect(0), projFoV(0)
 //==========================================================================
 {
 }
@@ -122,18 +127,51 @@ setProjection(bool doClear)
   glMatrixMode(GL_PROJECTION);
   if (doClear)
 	  glLoadIdentity();
-
-  // Compute the aspect ratio so we don't distort things
-  double aspect = ((double) wind->w()) / ((double) wind->h());
-  gluPerspective(fieldOfView, aspect, .1, 1000);
+  glMultMatrixf(&getProjectionMatrix()[0][0]);
 
   // Put the camera where we want it to be
   glMatrixMode(GL_MODELVIEW);
-  glLoadIdentity();
+  glLoadMatrixf(&getViewMatrix()[0][0]);
+}
 
-  // Use the transformation in the ArcBall
-  glTranslatef(-eyeX, -eyeY, -eyeZ);
-  multMatrix();
+//**************************************************************************
+//
+// * The view matrix: move the eye back, then the transformation in the 
+//   ArcBall
+//==========================================================================
+const glm::mat4& ArcBallCam::
+getViewMatrix()
+//==========================================================================
+{
+	if (viewDirty) {
+		// an HMatrix is laid out just like OpenGL (and glm) expect
+		HMatrix m;
+		getMatrix(m);
+		glm::mat4 ball;
+		memcpy(&ball[0][0], m, sizeof(HMatrix));
+
+		view = glm::translate(glm::mat4(), glm::vec3(-eyeX, -eyeY, -eyeZ)) * ball;
+		viewDirty = false;
+	}
+	return view;
+}
+
+//**************************************************************************
+//
+// * The projection matrix: a perspective that fits the window
+//==========================================================================
+const glm::mat4& ArcBallCam::
+getProjectionMatrix()
+//==========================================================================
+{
+	// Compute the aspect ratio so we don't distort things
+	float aspect = ((float) wind->w()) / ((float) wind->h());
+	if (aspect != projAspect || fieldOfView != projFoV) {
+		projection = glm::perspective(glm::radians(fieldOfView), aspect, .1f, 1000.0f);
+		projAspect = aspect;
+		projFoV = fieldOfView;
+	}
+	return projection;
 }
 
 //**************************************************************************
@@ -192,6 +230,7 @@ handle(int e)
 		case FL_MOUSEWHEEL: {
 			float zamt = (Fl::event_dy() < 0) ? 1.1f : 1/1.1f;
 			eyeZ *= zamt;
+			viewDirty = true;
 			wind->damage(1);
 			return 1;
 			};
@@ -241,6 +280,8 @@ down(const float x, const float y)
 
 	panX = 0;
 	panY = 0;
+
+	viewDirty = true;
 }
 
 //**************************************************************************
@@ -283,6 +324,8 @@ reset()
 	start.w = 1;
 
 	now.x = now.y = now.z = 0; now.w = 1;
+
+	viewDirty = true;
 }
 
 //**************************************************************************
@@ -311,6 +354,8 @@ spin(float x, float y, float z)
 
 	start.renorm();
 	// printf("start is %g %g %g %g\n",start.x,start.y,start.z,start.w);
+
+	viewDirty = true;
 }
 
 //**************************************************************************
@@ -366,6 +411,8 @@ computeNow(const float nowX, const float nowY)
 		panX = dx;
 		panY = dy;
 	}
+
+	viewDirty = true;
 }
 
 //*****************************************************************************
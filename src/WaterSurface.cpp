@@ -0,0 +1,252 @@
+/************************************************************************
+     File:        WaterSurface.cpp
+
+     Comment:     Where does the mouse ray hit the water?
+
+						This mirrors the displacement in water.vert and 
+						heightMap.vert - if those change, this has to follow.
+						The ripples aren't simulated here: TrainView reads 
+						the simulation's heights back and hands them over
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <math.h>
+
+#include "WaterSurface.H"
+
+const float WaterSurface::rippleHeight = 0.04f;
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+WaterSurface::
+WaterSurface()
+	: center(0, 0, 0), scale(1),
+	  wave(SinWave), amplitude(0), waveLength(1), speed(0), time(0), heightField(0),
+	  rippleSize(0), rippleMax(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * Keep a shrunk copy of one height map (nearest sampling is plenty 
+//   for picking)
+//============================================================================
+void WaterSurface::
+addHeightField(const unsigned char* pixels, int width, int height, 
+					int channels, int stride)
+//============================================================================
+{
+	size_t base = fields.size();
+	fields.resize(base + fieldSize * fieldSize);
+	for (int j = 0; j < fieldSize; ++j) {
+		const unsigned char* row = pixels + (size_t) (j * height / fieldSize) * stride;
+		for (int i = 0; i < fieldSize; ++i)
+			fields[base + j * fieldSize + i] = row[(i * width / fieldSize) * channels];
+	}
+}
+
+//****************************************************************************
+//
+// * Where the water plane is
+//============================================================================
+void WaterSurface::
+place(const glm::vec3& _center, float _scale)
+//============================================================================
+{
+	center = _center;
+	scale = _scale;
+}
+
+//****************************************************************************
+//
+// * What the displacement is right now
+//============================================================================
+void WaterSurface::
+setWave(Wave _wave, float _amplitude, float _waveLength, 
+		  float _speed, float _time, int _heightField)
+//============================================================================
+{
+	wave = _wave;
+	amplitude = _amplitude;
+	waveLength = _waveLength;
+	speed = _speed;
+	time = _time;
+	heightField = _heightField;
+}
+
+//****************************************************************************
+//
+// * The ripples as the simulation last had them
+//============================================================================
+void WaterSurface::
+setRipples(std::vector<float>& heights, int size)
+//============================================================================
+{
+	ripples.swap(heights);
+	rippleSize = size;
+	rippleMax = 0;
+	for (size_t i = 0; i < ripples.size(); ++i)
+		rippleMax = fmaxf(rippleMax, fabsf(ripples[i]));
+}
+
+//****************************************************************************
+//
+// * Bilinear lookup in the ripples - clamped at the edges
+//============================================================================
+float WaterSurface::
+sampleRipple(float u, float v) const
+//============================================================================
+{
+	if (!rippleSize || ripples.size() < (size_t) rippleSize * rippleSize)
+		return 0;
+
+	float x = fminf(fmaxf(u * rippleSize - 0.5f, 0.0f), rippleSize - 1.0f);
+	float y = fminf(fmaxf(v * rippleSize - 0.5f, 0.0f), rippleSize - 1.0f);
+	int x0 = (int) x, y0 = (int) y;
+	int x1 = (x0 + 1 < rippleSize) ? x0 + 1 : x0;
+	int y1 = (y0 + 1 < rippleSize) ? y0 + 1 : y0;
+	float ax = x - x0, ay = y - y0;
+
+	const float* r = &ripples[0];
+	float top = r[y0 * rippleSize + x0] * (1 - ax) + r[y0 * rippleSize + x1] * ax;
+	float bot = r[y1 * rippleSize + x0] * (1 - ax) + r[y1 * rippleSize + x1] * ax;
+	return top * (1 - ay) + bot * ay;
+}
+
+//****************************************************************************
+//
+// * Bilinear lookup in a kept height field - wraps like GL_REPEAT
+//============================================================================
+float WaterSurface::
+sampleField(int field, float u, float v) const
+//============================================================================
+{
+	const unsigned char* f = &fields[(size_t) field * fieldSize * fieldSize];
+
+	float x = u * fieldSize - 0.5f;
+	float y = v * fieldSize - 0.5f;
+	float fx = floorf(x), fy = floorf(y);
+	float ax = x - fx, ay = y - fy;
+
+	int x0 = ((int) fx % fieldSize + fieldSize) % fieldSize;
+	int y0 = ((int) fy % fieldSize + fieldSize) % fieldSize;
+	int x1 = (x0 + 1) % fieldSize;
+	int y1 = (y0 + 1) % fieldSize;
+
+	float top = f[y0 * fieldSize + x0] * (1 - ax) + f[y0 * fieldSize + x1] * ax;
+	float bot = f[y1 * fieldSize + x0] * (1 - ax) + f[y1 * fieldSize + x1] * ax;
+	return (top * (1 - ay) + bot * ay) / 255.0f;
+}
+
+//****************************************************************************
+//
+// * The displaced height, in world space
+//============================================================================
+float WaterSurface::
+height(float x, float z) const
+//============================================================================
+{
+	// into the space of water.obj (x and z from -1 to 1)
+	float lx = (x - center.x) / scale;
+	float lz = (z - center.z) / scale;
+
+	float y = 0;
+	if (wave == SinWave) {
+		float k = 2 * 3.1415926f / waveLength;
+		y = amplitude * sinf(k * (lx - speed * time));
+	}
+	else if (wave == HeightMap && !fields.empty()) {
+		int nfields = (int) (fields.size() / (fieldSize * fieldSize));
+		y = amplitude * sampleField(heightField % nfields, (lx + 1) * 0.5f, (1 - lz) * 0.5f);
+	}
+	y += rippleHeight * sampleRipple((lx + 1) * 0.5f, (1 - lz) * 0.5f);
+	return center.y + y * scale;
+}
+
+//****************************************************************************
+//
+// * Clip the ray to the slab the surface lives in, march along it until
+//   it goes under the surface, then bisect to find the crossing
+//============================================================================
+bool WaterSurface::
+intersect(const glm::vec3& origin, const glm::vec3& dir,
+			 glm::vec3& hit, glm::vec2& uv) const
+//============================================================================
+{
+	if (fabsf(dir.y) < 1e-6f)
+		return false;
+
+	// the surface stays between these two planes
+	float lo = center.y, hi = center.y;
+	if (wave == SinWave)
+		lo -= amplitude * scale;
+	hi += amplitude * scale;
+	lo -= rippleHeight * rippleMax * scale;
+	hi += rippleHeight * rippleMax * scale;
+
+	float t0 = (hi - origin.y) / dir.y;
+	float t1 = (lo - origin.y) / dir.y;
+	if (t0 > t1) {
+		float t = t0; t0 = t1; t1 = t;
+	}
+	if (t1 < 0)
+		return false;
+	if (t0 < 0)
+		t0 = 0;
+
+	// flat water (or the slab is a single plane) - the plane is the answer
+	float t = t0;
+	if (t1 - t0 > 1e-4f) {
+		const int steps = 32;
+		float dt = (t1 - t0) / steps;
+		glm::vec3 p = origin + dir * t0;
+		float prev = p.y - height(p.x, p.z);
+		t = t1;
+		for (int i = 1; i <= steps; ++i) {
+			float ti = t0 + dt * i;
+			p = origin + dir * ti;
+			float d = p.y - height(p.x, p.z);
+			// crossed from one side of the surface to the other
+			if ((d <= 0) != (prev <= 0)) {
+				float a = ti - dt, b = ti;
+				for (int k = 0; k < 10; ++k) {
+					float m = (a + b) * 0.5f;
+					glm::vec3 q = origin + dir * m;
+					float dm = q.y - height(q.x, q.z);
+					if ((dm <= 0) == (prev <= 0))
+						a = m;
+					else
+						b = m;
+				}
+				t = (a + b) * 0.5f;
+				break;
+			}
+			prev = d;
+		}
+	}
+
+	hit = origin + dir * t;
+	return rippleCoord(hit.x, hit.z, uv);
+}
+
+//****************************************************************************
+//
+// * The texture coordinates water.obj gives a spot
+//============================================================================
+bool WaterSurface::
+rippleCoord(float x, float z, glm::vec2& uv) const
+//============================================================================
+{
+	float lx = (x - center.x) / scale;
+	float lz = (z - center.z) / scale;
+	if (lx < -1 || lx > 1 || lz < -1 || lz > 1)
+		return false;
+
+	uv = glm::vec2((lx + 1) * 0.5f, (1 - lz) * 0.5f);
+	return true;
+}
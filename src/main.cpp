@@ -23,7 +23,11 @@
 *************************************************************************/
 
 #include "stdio.h"
+#include <stdlib.h>
+#include <string.h>
 #include "TrainWindow.H"
+#include "TrainView.H"
+#include "TrackFile.H"
 
 #pragma warning(push)
 #pragma warning(disable:4312)
@@ -32,12 +36,59 @@
 #pragma warning(pop)
 
 
-int main(int, char**)
+int main(int argc, char** argv)
 {
 	printf("CS559 Train Assignment\n");
 
+	// --core : draw with a core profile context (shaders only)
+	// --render-thread : draw on a thread of its own, apart from the events
+	// --loopback-audio : mix the sounds without an audio device
+	// --check-allocations : fail (exit 1) if a frame allocates once the
+	//   frames have settled
+	// --check-allocations=<frames> : the same, with the train running,
+	//   closing by itself after <frames> settled frames
+	// --convert <in> <out> : rewrite a track file in the format <out>'s
+	//   name asks for (.trk is binary), without opening the window
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--convert") && i + 2 < argc) {
+			std::vector<ControlPoint> points;
+			std::string error;
+			if (!TrackFile::read(argv[i + 1], points, error) ||
+				 !TrackFile::write(argv[i + 2], points, TrackFile::formatOf(argv[i + 2]), error)) {
+				printf("%s\n", error.c_str());
+				return 1;
+			}
+			printf("%lu points from %s to %s\n", (unsigned long) points.size(), argv[i + 1], argv[i + 2]);
+			return 0;
+		}
+		if (!strcmp(argv[i], "--core"))
+			TrainView::core_profile = true;
+		if (!strcmp(argv[i], "--render-thread"))
+			TrainView::render_thread_mode = true;
+		if (!strcmp(argv[i], "--loopback-audio"))
+			TrainView::loopback_audio = true;
+		if (!strcmp(argv[i], "--check-allocations"))
+			TrainView::check_allocations = true;
+		if (!strncmp(argv[i], "--check-allocations=", 20)) {
+			TrainView::check_allocations = true;
+			TrainView::check_frames = atoi(argv[i] + 20);
+		}
+	}
+	// the render thread tells the UI about each frame with Fl::awake,
+	// which needs FLTK's lock (as does the check finishing)
+	if (TrainView::render_thread_mode || TrainView::check_frames > 0)
+		Fl::lock();
+
 	TrainWindow tw;
+	// something has to keep the frames coming
+	if (TrainView::check_frames > 0)
+		tw.runButton->value(1);
 	tw.show();
 
-	Fl::run();
+	int result = Fl::run();
+	if (TrainView::check_allocations && TrainView::allocating_frames) {
+		printf("%d settled frames allocated\n", TrainView::allocating_frames);
+		return 1;
+	}
+	return result;
 }
\ No newline at end of file
@@ -0,0 +1,32 @@
+#version 430 core
+out vec4 f_color;
+
+in V_OUT
+{
+    vec3 normal;
+    vec3 color;
+}f_in;
+
+uniform bool u_shadow;
+uniform bool u_top_view;
+
+void main()
+{
+    // draw in transparent black (to dim the floor)
+    if (u_shadow)
+    {
+        f_color = vec4(0.0, 0.0, 0.0, 0.5);
+        return;
+    }
+
+    // the lights TrainView::draw sets up for the fixed pipeline
+    vec3 norm = normalize(f_in.normal);
+    vec3 light = vec3(0.2) + vec3(0.3) + vec3(1.0) * max(dot(norm, normalize(vec3(0, 1, 1))), 0.0);
+    // top view only needs one light
+    if (!u_top_view)
+    {
+        light += vec3(0.5, 0.5, 0.1) * max(dot(norm, vec3(1, 0, 0)), 0.0);
+        light += vec3(0.1, 0.1, 0.3) * max(dot(norm, vec3(0, -1, 0)), 0.0);
+    }
+    f_color = vec4(f_in.color * light, 1.0);
+}
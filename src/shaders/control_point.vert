@@ -0,0 +1,45 @@
+#version 430 core
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+// per-instance: where the point is, where it points, and if it is selected
+layout (location = 2) in vec3 instance_position;
+layout (location = 3) in vec3 instance_orient;
+layout (location = 4) in float instance_selected;
+
+uniform bool u_shadow;
+
+ layout (std140, binding = 0) uniform commom_matrices
+ {
+     mat4 u_projection;
+     mat4 u_view;
+ };
+
+out V_OUT
+{
+    vec3 normal;
+    vec3 color;
+}v_out;
+
+void main()
+{
+  // same rotations as ControlPoint::draw - about y, then about z
+  float theta1 = -atan(instance_orient.z, instance_orient.x);
+  float theta2 = -acos(clamp(instance_orient.y, -1.0, 1.0));
+  mat3 rotate_y = mat3(cos(theta1), 0, -sin(theta1),
+                       0, 1, 0,
+                       sin(theta1), 0, cos(theta1));
+  mat3 rotate_z = mat3(cos(theta2), sin(theta2), 0,
+                       -sin(theta2), cos(theta2), 0,
+                       0, 0, 1);
+  mat3 rotation = rotate_y * rotate_z;
+
+  vec3 pos = instance_position + rotation * position;
+  // squish onto the floor for the shadow pass
+  if (u_shadow)
+    pos.y = 0.0;
+
+  gl_Position = u_projection * u_view * vec4(pos, 1.0f);
+
+  v_out.normal = rotation * normal;
+  v_out.color = instance_selected > 0.5 ? vec3(240, 240, 30) / 255.0 : vec3(240, 60, 60) / 255.0;
+}
@@ -0,0 +1,6 @@
+#version 430 core
+// the water's depth prepass - nothing to shade, only the depth is written
+
+void main()
+{
+}
@@ -3,7 +3,9 @@
 out vec4 fragColor;
 in vec2 coord;
 uniform sampler2D u_water;
-uniform vec2 u_center;
+#define MAX_DROPS 16
+uniform vec2 u_centers[MAX_DROPS];
+uniform int u_drop_count;
 uniform float u_radius;
 uniform float u_strength;
 
@@ -12,12 +14,15 @@ void main() {
     vec2 u_delta=vec2(0.01,0.01);
     vec4 info = texture(u_water, coord);
     
-    if(u_center.x>0)
+    if(u_drop_count>0)
     {
-    float drop = max(0.0, 1.0 - length(u_center  - coord) / u_radius);
+    for(int i=0;i<u_drop_count;i++)
+    {
+    float drop = max(0.0, 1.0 - length(u_centers[i]  - coord) / u_radius);
     drop =0.5-cos(drop * PI)*0.5;
     info.r += drop * u_strength;
     }
+    }
     else{
     vec2 dx=vec2(u_delta.x,0.0);
     vec2 dy=vec2(0.0,u_delta.y);
@@ -1,12 +0,0 @@
-#version 430 core
-
-out vec4 FragColor;
-
-in vec2 TexCoords;
-
-uniform sampler2D texture1;
-
-void main()
-{    
-    FragColor = texture(texture1, TexCoords);
-}
\ No newline at end of file
@@ -1,45 +1,42 @@
 #version 430 core
+// the resolve: the scene scaled up to the window (dynamic resolution),
+// sharpened, with the bloom added. the rest of the effects come after
 
 out vec4 FragColor;
 
 in vec2 TexCoords;
 
 uniform sampler2D screenTexture;
+uniform sampler2D u_bloom;
 
-uniform float screen_w; 
-uniform float screen_h; 
-uniform bool isPixel;
+// the scene may only fill part of screenTexture
+uniform vec2 u_uv_scale;    // the part it fills
+uniform vec2 u_uv_max;      // the last texel centre inside it
+uniform vec2 u_texel;       // one texel of screenTexture
+uniform float u_sharpness;  // 0 at full size
+uniform float u_bloom_strength;   // 0 when there is no bloom
 
-
-void main()
+// the scene at uv (0-1 over the window), and, when it was rendered
+// smaller, sharpened back a little (unsharp mask of the neighbours)
+vec3 scene(vec2 uv)
 {
-    float pixel_w=15;
-    float pixel_h=10;
-    float offset=0.5;
-   
-     vec3 col = texture(screenTexture, TexCoords).rgb;
-     FragColor = vec4(col, 1.0);
-    if(isPixel)
-    {
-      vec2 uv = TexCoords.xy;
-            vec3 tc = vec3(1.0, 0.0, 0.0);
-            if (uv.x < (offset-0.005))
-            {
-            float dx = pixel_w*(1./screen_w);
-            float dy = pixel_h*(1./screen_h);
-            vec2 coord = vec2(dx*floor(uv.x/dx),
-                                dy*floor(uv.y/dy));
-            tc = texture2D(screenTexture, coord).rgb;
-            }
-            else if (uv.x>=(offset+0.005))
-            {
-            tc = texture2D(screenTexture, uv).rgb;
-            }
-            FragColor = vec4(tc, 1.0);
-    }
-    else
+    vec2 st = min(uv * u_uv_scale, u_uv_max);
+    vec3 col = texture(screenTexture, st).rgb;
+    if (u_sharpness > 0.0)
     {
-       vec3 col = texture(screenTexture, TexCoords).rgb;
-     FragColor = vec4(col, 1.0);
+        vec3 around = texture(screenTexture, min(st + vec2(u_texel.x, 0.0), u_uv_max)).rgb
+                    + texture(screenTexture, max(st - vec2(u_texel.x, 0.0), vec2(0.0))).rgb
+                    + texture(screenTexture, min(st + vec2(0.0, u_texel.y), u_uv_max)).rgb
+                    + texture(screenTexture, max(st - vec2(0.0, u_texel.y), vec2(0.0))).rgb;
+        col = max(col + u_sharpness * (col - 0.25 * around), vec3(0.0));
     }
-} 
\ No newline at end of file
+    return col;
+}
+
+void main()
+{
+    vec3 col = scene(TexCoords);
+    if (u_bloom_strength > 0.0)
+        col += u_bloom_strength * texture(u_bloom, TexCoords).rgb;
+    FragColor = vec4(col, 1.0);
+}
@@ -2,8 +2,6 @@
 out vec4 f_color;
 
 struct Material{
-    sampler2D diffuse;
-    sampler2D specular;
     float shininess;
 };
 
@@ -36,10 +34,14 @@ vec3 normal;
 vec2 texture_coordinate;
 }f_in;
 
-uniform vec3 viewPos;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform Material material;
+// per draw, from the stream buffer (WaterLighting in TrainView.cpp)
+layout (std140, binding = 1) uniform water_lighting
+{
+    vec3 viewPos;
+    Material material;
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+};
 
 vec3 CalcDirLight(DirLight light,vec3 normal,vec3 viewDir);
 vec3 CalcPointLight(PointLight light,vec3 normal,vec3 position,vec3 viewDir);
@@ -49,7 +51,28 @@ uniform sampler2D u_heightMap;
 uniform sampler2D u_ripple;
 uniform samplerCube tile;
 uniform samplerCube skybox;
+uniform samplerCube u_environment;  // skybox prefiltered by roughness, one per level
+uniform sampler2D u_brdf;           // scale and bias on F0, by (n.v, roughness)
+uniform float u_environment_lod;    // its last level (roughness 1)
+uniform float u_roughness;
+uniform samplerCube u_probe;        // the scene from the middle of the water
+uniform bool u_use_probe;
+uniform float u_probe_lod;          // its last level
 uniform float f_amplitude;
+uniform float u_ripple_height;      // how high a ripple of 1 is (WaterSurface::rippleHeight)
+
+// n tilted by the slope of the ripples. they are stored the way the
+// vertex shader reads them, v flipped from these coordinates; the water's
+// -1..1 spans 0..1 of them, hence the half
+vec3 rippleNormal(vec3 n)
+{
+    vec2 uv=vec2(f_in.texture_coordinate.x,1.0-f_in.texture_coordinate.y);
+    vec2 e=1.0/vec2(textureSize(u_ripple,0));
+    float du=(texture(u_ripple,uv+vec2(e.x,0.0)).r-texture(u_ripple,uv-vec2(e.x,0.0)).r)/(2.0*e.x);
+    float dv=(texture(u_ripple,uv+vec2(0.0,e.y)).r-texture(u_ripple,uv-vec2(0.0,e.y)).r)/(2.0*e.y);
+    vec2 slope=vec2(du,-dv)*0.5*u_ripple_height;
+    return normalize(n+vec3(-slope.x,0.0,-slope.y));
+}
 
 void main()
 {   
@@ -62,7 +85,7 @@ void main()
 
     dy=texture(u_heightMap,vec2(f_in.texture_coordinate.x,f_in.texture_coordinate.y+dz)).r-info.r;
     vec3 dv=vec3(0.0,dy*f_amplitude,dz);
-    vec3 norm = normalize(cross(dv,du));
+    vec3 norm = rippleNormal(normalize(cross(dv,du)));
 
     vec3 viewDir = normalize(viewPos - f_in.position-vec3(0,f_amplitude*texture(u_heightMap,f_in.texture_coordinate).r,0));
      vec3 result = vec3(texture(u_texture,f_in.texture_coordinate));
@@ -74,8 +97,9 @@ void main()
      }
     float ratio=1.0/1.33;
     vec3 I=normalize(f_in.position+vec3(0,f_amplitude*texture(u_heightMap,f_in.texture_coordinate).r,0)-viewPos);
-    vec3 R1=reflect(I,normalize(f_in.normal));
-    vec3 R2=refract(I,normalize(f_in.normal),ratio);
+    vec3 surface_normal=rippleNormal(normalize(f_in.normal));
+    vec3 R1=reflect(I,surface_normal);
+    vec3 R2=refract(I,surface_normal,ratio);
     R2=normalize(R2);
     float face[5];
     face[0]=(-100-f_amplitude*texture(u_heightMap,f_in.texture_coordinate).r)/R2.y;
@@ -91,7 +115,14 @@ void main()
     }
     R2=R2*(mini);
    vec3 vector=normalize(R2+f_in.position+vec3(0,f_amplitude*texture(u_heightMap,f_in.texture_coordinate).r,0));
-  f_color =mix(mix(vec4(result,1.0),texture(tile,vector),0.6),texture(skybox,R1),0.6)+vec4(dirlight,1.0);
+    // glossy reflection: the prefiltered sky, weighted by the fresnel of
+    // water (F0 = 0.02) from the brdf table
+    // (or the probe, when there is one - it sees the pool and the points too)
+    vec3 reflected=u_use_probe ? textureLod(u_probe,R1,u_roughness*u_probe_lod).rgb
+                               : textureLod(u_environment,R1,u_roughness*u_environment_lod).rgb;
+    vec2 brdf=texture(u_brdf,vec2(max(dot(norm,viewDir),0.0),u_roughness)).rg;
+    float fresnel=clamp(0.02*brdf.x+brdf.y,0.0,1.0);
+  f_color =mix(mix(vec4(result,1.0),texture(tile,vector),0.6),vec4(reflected,1.0),fresnel)+vec4(dirlight,1.0);
    //f_color = vec4(result,1.0);//+vec4(dirlight,1.0);
     //f_color=texture(u_ripple,f_in.texture_coordinate);
 }
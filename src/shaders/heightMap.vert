@@ -7,6 +7,7 @@ uniform mat4 u_model;
 uniform sampler2D heightMap;
 uniform sampler2D ripple;
 uniform float amplitude;
+uniform float u_ripple_height;   // how high a ripple of 1 is
 
  layout (std140, binding = 0) uniform commom_matrices
  {
@@ -14,6 +15,9 @@ uniform float amplitude;
      mat4 u_view;
  };
 
+// the depth prepass runs this too, so the depths must match exactly
+invariant gl_Position;
+
 out V_OUT
 {
     vec3 position;
@@ -26,7 +30,7 @@ out V_OUT
 void main()
 {
   vec3 pos=position; 
-  pos.y=pos.y+amplitude*(texture(heightMap,texture_coordinate).r);//+texture(ripple,texture_coordinate).r*0.5;
+  pos.y=pos.y+amplitude*(texture(heightMap,texture_coordinate).r)+u_ripple_height*texture(ripple,texture_coordinate).r;
  
   gl_Position = u_projection *u_view * u_model * vec4(pos, 1.0f);
 
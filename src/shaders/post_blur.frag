@@ -0,0 +1,23 @@
+#version 430 core
+// one direction of a 9 tap gaussian, in 5 bilinear taps
+
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D u_source;
+uniform vec2 u_direction;   // one texel along the blur
+
+void main()
+{
+    const float offsets[3] = float[](0.0, 1.3846153846, 3.2307692308);
+    const float weights[3] = float[](0.2270270270, 0.3162162162, 0.0702702703);
+
+    vec3 col = texture(u_source, TexCoords).rgb * weights[0];
+    for (int i = 1; i < 3; i++)
+    {
+        col += texture(u_source, TexCoords + offsets[i] * u_direction).rgb * weights[i];
+        col += texture(u_source, TexCoords - offsets[i] * u_direction).rgb * weights[i];
+    }
+    FragColor = vec4(col, 1.0);
+}
@@ -0,0 +1,28 @@
+#version 430 core
+// the start of the bloom: what is brighter than the threshold, at half size
+// (four taps between the texels, so every scene texel counts)
+
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D u_source;
+uniform vec2 u_uv_scale;    // the part of u_source the scene fills
+uniform vec2 u_uv_max;
+uniform vec2 u_texel;       // one texel of u_source
+uniform float u_threshold;
+
+vec3 tap(vec2 offset)
+{
+    return texture(u_source, min(TexCoords * u_uv_scale + offset * u_texel, u_uv_max)).rgb;
+}
+
+void main()
+{
+    vec3 col = 0.25 * (tap(vec2(-0.5, -0.5)) + tap(vec2(0.5, -0.5)) + tap(vec2(-0.5, 0.5)) + tap(vec2(0.5, 0.5)));
+    // a soft knee, so things don't pop in as they cross the threshold
+    float brightness = max(col.r, max(col.g, col.b));
+    float knee = clamp(brightness - u_threshold + 0.25, 0.0, 0.5);
+    float weight = max(brightness - u_threshold, knee * knee) / max(brightness, 0.0001);
+    FragColor = vec4(col * weight, 1.0);
+}
@@ -0,0 +1,18 @@
+#version 430 core
+// half the size: four bilinear taps, 16 source texels
+
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D u_source;
+uniform vec2 u_texel;       // one texel of u_source
+
+void main()
+{
+    vec3 col = texture(u_source, TexCoords + vec2(-1.0, -1.0) * u_texel).rgb
+             + texture(u_source, TexCoords + vec2(1.0, -1.0) * u_texel).rgb
+             + texture(u_source, TexCoords + vec2(-1.0, 1.0) * u_texel).rgb
+             + texture(u_source, TexCoords + vec2(1.0, 1.0) * u_texel).rgb;
+    FragColor = vec4(0.25 * col, 1.0);
+}
@@ -0,0 +1,45 @@
+#version 430 core
+// FXAA (the simple, console style one): find edges from the luma of the
+// neighbours and blend along them
+
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D u_source;
+uniform vec2 u_texel;       // one texel of u_source
+
+const float reduceMin = 1.0 / 128.0;
+const float reduceMul = 1.0 / 8.0;
+const float spanMax = 8.0;
+
+float luma(vec3 col)
+{
+    return dot(col, vec3(0.299, 0.587, 0.114));
+}
+
+void main()
+{
+    vec3 rgbM = texture(u_source, TexCoords).rgb;
+    float lumaNW = luma(texture(u_source, TexCoords + vec2(-1.0, -1.0) * u_texel).rgb);
+    float lumaNE = luma(texture(u_source, TexCoords + vec2(1.0, -1.0) * u_texel).rgb);
+    float lumaSW = luma(texture(u_source, TexCoords + vec2(-1.0, 1.0) * u_texel).rgb);
+    float lumaSE = luma(texture(u_source, TexCoords + vec2(1.0, 1.0) * u_texel).rgb);
+    float lumaM = luma(rgbM);
+
+    float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+    float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+
+    // the direction along the edge
+    vec2 dir = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)), (lumaNW + lumaSW) - (lumaNE + lumaSE));
+    float dirReduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25 * reduceMul, reduceMin);
+    float rcpDirMin = 1.0 / (min(abs(dir.x), abs(dir.y)) + dirReduce);
+    dir = clamp(dir * rcpDirMin, vec2(-spanMax), vec2(spanMax)) * u_texel;
+
+    vec3 rgbA = 0.5 * (texture(u_source, TexCoords + dir * (1.0 / 3.0 - 0.5)).rgb +
+                       texture(u_source, TexCoords + dir * (2.0 / 3.0 - 0.5)).rgb);
+    vec3 rgbB = rgbA * 0.5 + 0.25 * (texture(u_source, TexCoords + dir * -0.5).rgb +
+                                     texture(u_source, TexCoords + dir * 0.5).rgb);
+    float lumaB = luma(rgbB);
+    FragColor = vec4((lumaB < lumaMin || lumaB > lumaMax) ? rgbA : rgbB, 1.0);
+}
@@ -0,0 +1,30 @@
+#version 430 core
+// pixelate the left half of the screen (the right half is left as is)
+
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D u_source;
+uniform float screen_w;
+uniform float screen_h;
+
+void main()
+{
+    const float pixel_w = 15;
+    const float pixel_h = 10;
+    const float offset = 0.5;
+
+    vec2 uv = TexCoords.xy;
+    vec3 tc = vec3(1.0, 0.0, 0.0);  // the line between the halves
+    if (uv.x < (offset - 0.005))
+    {
+        float dx = pixel_w * (1. / screen_w);
+        float dy = pixel_h * (1. / screen_h);
+        vec2 coord = vec2(dx * floor(uv.x / dx), dy * floor(uv.y / dy));
+        tc = texture(u_source, coord).rgb;
+    }
+    else if (uv.x >= (offset + 0.005))
+        tc = texture(u_source, uv).rgb;
+    FragColor = vec4(tc, 1.0);
+}
@@ -0,0 +1,20 @@
+#version 430 core
+// bring the scene (which may be brighter than 1 - the highlights, the
+// bloom) into range: exposure, then the ACES filmic curve
+
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D u_source;
+uniform float u_exposure;
+
+vec3 aces(vec3 x)
+{
+    return clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+}
+
+void main()
+{
+    FragColor = vec4(aces(texture(u_source, TexCoords).rgb * u_exposure), 1.0);
+}
@@ -0,0 +1,84 @@
+#version 430 core
+out vec4 f_color;
+in vec2 ndc;
+
+uniform samplerCube u_source;
+uniform int u_face;
+uniform float u_roughness;
+uniform float u_source_size;    // width of the source's top level
+uniform float u_base_lod;       // the source level as big as this face
+
+const float PI = 3.141592653589793;
+const uint SAMPLES = 128u;
+
+// where a texel of a cube face points (the GL face layout)
+vec3 faceDirection(int face, vec2 uv)
+{
+    if (face == 0) return vec3( 1.0, -uv.y, -uv.x);
+    if (face == 1) return vec3(-1.0, -uv.y,  uv.x);
+    if (face == 2) return vec3( uv.x,  1.0,  uv.y);
+    if (face == 3) return vec3( uv.x, -1.0, -uv.y);
+    if (face == 4) return vec3( uv.x, -uv.y,  1.0);
+    return vec3(-uv.x, -uv.y, -1.0);
+}
+
+vec2 hammersley(uint i, uint n)
+{
+    return vec2(float(i) / float(n), float(bitfieldReverse(i)) * 2.3283064365386963e-10);
+}
+
+vec3 importanceSampleGGX(vec2 xi, vec3 n, float roughness)
+{
+    float a = roughness * roughness;
+    float phi = 2.0 * PI * xi.x;
+    float cos_theta = sqrt((1.0 - xi.y) / (1.0 + (a * a - 1.0) * xi.y));
+    float sin_theta = sqrt(1.0 - cos_theta * cos_theta);
+    vec3 h = vec3(cos(phi) * sin_theta, sin(phi) * sin_theta, cos_theta);
+
+    vec3 up = abs(n.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(up, n));
+    vec3 bitangent = cross(n, tangent);
+    return normalize(tangent * h.x + bitangent * h.y + n * h.z);
+}
+
+float distributionGGX(float n_dot_h, float roughness)
+{
+    float a2 = roughness * roughness * roughness * roughness;
+    float d = n_dot_h * n_dot_h * (a2 - 1.0) + 1.0;
+    return a2 / (PI * d * d);
+}
+
+void main()
+{
+    // the usual split sum assumption: looking straight down the normal
+    vec3 n = normalize(faceDirection(u_face, ndc));
+    vec3 v = n;
+
+    if (u_roughness == 0.0)
+    {
+        f_color = vec4(textureLod(u_source, n, u_base_lod).rgb, 1.0);
+        return;
+    }
+
+    // each sample reads a source level as wide as its share of the lobe,
+    // so a few samples still give a smooth result
+    float texel_angle = 4.0 * PI / (6.0 * u_source_size * u_source_size);
+    vec3 color = vec3(0.0);
+    float weight = 0.0;
+    for (uint i = 0u; i < SAMPLES; i++)
+    {
+        vec3 h = importanceSampleGGX(hammersley(i, SAMPLES), n, u_roughness);
+        vec3 l = normalize(2.0 * dot(v, h) * h - v);
+        float n_dot_l = dot(n, l);
+        if (n_dot_l > 0.0)
+        {
+            float n_dot_h = max(dot(n, h), 0.0);
+            float pdf = distributionGGX(n_dot_h, u_roughness) * 0.25 + 0.0001;
+            float sample_angle = 1.0 / (float(SAMPLES) * pdf + 0.0001);
+            float lod = max(0.5 * log2(sample_angle / texel_angle), u_base_lod);
+            color += textureLod(u_source, l, lod).rgb * n_dot_l;
+            weight += n_dot_l;
+        }
+    }
+    f_color = vec4(color / max(weight, 0.0001), 1.0);
+}
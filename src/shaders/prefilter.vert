@@ -0,0 +1,9 @@
+#version 430 core
+out vec2 ndc;
+
+// one triangle that covers the whole face
+void main()
+{
+    ndc = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+    gl_Position = vec4(ndc, 0.0, 1.0);
+}
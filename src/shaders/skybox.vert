@@ -13,6 +13,9 @@ out vec3 TexCoords;
 
 void main()
 {
-  gl_Position=u_projection*u_view*s_model*vec4(aPos,1.0);
+  // z = w puts it on the far plane: drawn last (with GL_LEQUAL), only the
+  // pixels nothing else covered get shaded
+  vec4 clip=u_projection*u_view*s_model*vec4(aPos,1.0);
+  gl_Position=clip.xyww;
     TexCoords=aPos;
 }
\ No newline at end of file
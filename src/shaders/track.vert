@@ -0,0 +1,32 @@
+#version 430 core
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+// 1 for the ties, 0 for the rails
+layout (location = 2) in float tie;
+
+uniform bool u_shadow;
+
+ layout (std140, binding = 0) uniform commom_matrices
+ {
+     mat4 u_projection;
+     mat4 u_view;
+ };
+
+out V_OUT
+{
+    vec3 normal;
+    vec3 color;
+}v_out;
+
+void main()
+{
+  vec3 pos = position;
+  // squish onto the floor for the shadow pass
+  if (u_shadow)
+    pos.y = 0.0;
+
+  gl_Position = u_projection * u_view * vec4(pos, 1.0f);
+
+  v_out.normal = normal;
+  v_out.color = tie > 0.5 ? vec3(115, 75, 40) / 255.0 : vec3(180, 180, 190) / 255.0;
+}
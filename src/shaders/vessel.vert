@@ -0,0 +1,37 @@
+#version 430 core
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+// per-instance: where the vessel is, which way it heads, and its up
+layout (location = 2) in vec3 instance_position;
+layout (location = 3) in vec3 instance_heading;
+layout (location = 4) in vec3 instance_up;
+
+uniform bool u_shadow;
+
+ layout (std140, binding = 0) uniform commom_matrices
+ {
+     mat4 u_projection;
+     mat4 u_view;
+ };
+
+out V_OUT
+{
+    vec3 normal;
+    vec3 color;
+}v_out;
+
+void main()
+{
+  // the hull's x goes along the heading, y up, z to starboard
+  mat3 rotation = mat3(instance_heading, instance_up, cross(instance_heading, instance_up));
+
+  vec3 pos = instance_position + rotation * position;
+  // squish onto the floor for the shadow pass
+  if (u_shadow)
+    pos.y = 0.0;
+
+  gl_Position = u_projection * u_view * vec4(pos, 1.0f);
+
+  v_out.normal = rotation * normal;
+  v_out.color = vec3(230, 225, 210) / 255.0;
+}
@@ -0,0 +1,17 @@
+#version 430 core
+out vec4 fragColor;
+// -1 .. 1 over the footprint, x from stern to bow
+in vec2 local;
+in float push;
+
+void main() {
+    const float PI = 3.141592653589793;
+    float r = length(local);
+    if (r >= 1.0)
+        discard;
+    // the same bump a drop makes, raised at the bow and lowered at the
+    // stern - what goes up comes from behind, so the water keeps its level
+    float bump = 0.5 + cos(r * PI) * 0.5;
+    // added (blended) to the simulation's height
+    fragColor = vec4(bump * local.x * push, 0.0, 0.0, 0.0);
+}
@@ -0,0 +1,23 @@
+#version 430 core
+// the corners of the quad the simulation is drawn with (-1 .. 1)
+layout(location = 0) in vec3 position;
+// per-vessel: the centre and heading in the ripple texture, and how hard
+// it pushes
+layout(location = 1) in vec2 center;
+layout(location = 2) in vec2 heading;
+layout(location = 3) in float strength;
+
+// half the hull's length and beam, in the ripple texture
+uniform vec2 u_half_size;
+
+out vec2 local;
+out float push;
+
+void main()
+{
+    vec2 side = vec2(-heading.y, heading.x);
+    vec2 coord = center + heading * position.x * u_half_size.x + side * position.y * u_half_size.y;
+    gl_Position = vec4(coord * 2.0 - 1.0, 0.0, 1.0);
+    local = position.xy;
+    push = strength;
+}
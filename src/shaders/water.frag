@@ -34,20 +34,39 @@ vec3 normal;
 vec2 texture_coordinate;
 }f_in;
 
-uniform vec3 viewPos;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform Material material;
+// per draw, from the stream buffer (WaterLighting in TrainView.cpp)
+layout (std140, binding = 1) uniform water_lighting
+{
+    vec3 viewPos;
+    Material material;
+    DirLight dirLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+};
 
 vec3 CalcDirLight(DirLight light,vec3 normal,vec3 viewDir);
 vec3 CalcPointLight(PointLight light,vec3 normal,vec3 position,vec3 viewDir);
 
 uniform sampler2D u_texture;
+uniform sampler2D u_ripple;
+uniform float u_ripple_height;      // how high a ripple of 1 is (WaterSurface::rippleHeight)
+
+// n tilted by the slope of the ripples. they are stored the way the
+// vertex shader reads them, v flipped from these coordinates; the water's
+// -1..1 spans 0..1 of them, hence the half
+vec3 rippleNormal(vec3 n)
+{
+    vec2 uv=vec2(f_in.texture_coordinate.x,1.0-f_in.texture_coordinate.y);
+    vec2 e=1.0/vec2(textureSize(u_ripple,0));
+    float du=(texture(u_ripple,uv+vec2(e.x,0.0)).r-texture(u_ripple,uv-vec2(e.x,0.0)).r)/(2.0*e.x);
+    float dv=(texture(u_ripple,uv+vec2(0.0,e.y)).r-texture(u_ripple,uv-vec2(0.0,e.y)).r)/(2.0*e.y);
+    vec2 slope=vec2(du,-dv)*0.5*u_ripple_height;
+    return normalize(n+vec3(-slope.x,0.0,-slope.y));
+}
 
 
 void main()
 {   
-    vec3 norm = normalize(f_in.normal);
+    vec3 norm = rippleNormal(normalize(f_in.normal));
     vec3 viewDir = normalize(viewPos - f_in.position);
     vec3 result = vec3(texture(u_texture,f_in.texture_coordinate));
     vec3 dirlight=CalcDirLight(dirLight, norm, viewDir);
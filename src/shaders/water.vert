@@ -6,6 +6,9 @@ layout (location = 2) in vec2 texture_coordinate;
 uniform mat4 u_model;
 
 uniform float time,speed,amplitude,waveLength;
+// the drops' and wakes' ripples, and how high one of 1 is
+uniform sampler2D ripple;
+uniform float u_ripple_height;
 
  layout (std140, binding = 0) uniform commom_matrices
  {
@@ -13,6 +16,9 @@ uniform float time,speed,amplitude,waveLength;
      mat4 u_view;
  };
 
+// the depth prepass runs this too, so the depths must match exactly
+invariant gl_Position;
+
 out V_OUT
 {
     vec3 position;
@@ -27,7 +33,7 @@ void main()
   vec3 pos=position; 
   float k=2*3.1415926/waveLength;
   float f=k*(pos.x-speed*time);
-  pos.y=amplitude*sin(f);
+  pos.y=amplitude*sin(f)+u_ripple_height*texture(ripple,texture_coordinate).r;
   vec3 tangent=normalize(vec3(1,k*amplitude*cos(f),0));
   vec3 newNormal=vec3(-tangent.y,tangent.x,0);
   